@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "audio.hpp"
+#include "executor.hpp"
+#include "profile.hpp"
+
+#include <alsa/asoundlib.h>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ModSynth
+{
+
+namespace
+{
+
+/**
+ * Audio output using an ALSA PCM device.
+ *
+ * The samples are written to the device from a separate thread, which blocks
+ * whenever the device's buffer is full.
+ */
+struct ALSADevice: Device {
+	snd_pcm_t *pcm{};             ///< The ALSA PCM handle.
+	std::size_t channels;         ///< The number of channels.
+	std::size_t period;           ///< The number of frames written at a time.
+	std::vector<float> buffer;    ///< The buffer holding one period of interleaved samples.
+	std::vector<float *> outputs; ///< Pointers to the first sample of each channel.
+	std::atomic<bool> quit{};     ///< Set when the thread should exit.
+	std::thread thread;           ///< The thread writing to the device.
+
+	/**
+	 * The constructor.
+	 *
+	 * @param settings  The settings to open the device with.
+	 */
+	ALSADevice(Settings &settings): channels(settings.channels)
+	{
+		auto name = settings.device.empty() ? "default" : settings.device.c_str();
+
+		if (int err = snd_pcm_open(&pcm, name, SND_PCM_STREAM_PLAYBACK, 0); err < 0) {
+			throw std::runtime_error(std::string("could not open PCM device: ") + snd_strerror(err));
+		}
+
+		// Ask for a buffer of two periods
+		unsigned int latency = 2e6 * settings.period / settings.sample_rate;
+
+		if (int err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_FLOAT, SND_PCM_ACCESS_RW_INTERLEAVED, channels, std::lround(settings.sample_rate), 1, latency); err < 0) {
+			snd_pcm_close(pcm);
+			throw std::runtime_error(std::string("could not configure PCM device: ") + snd_strerror(err));
+		}
+
+		snd_pcm_uframes_t buffer_size;
+		snd_pcm_uframes_t period_size;
+
+		if (snd_pcm_get_params(pcm, &buffer_size, &period_size) == 0) {
+			settings.period = period_size;
+		}
+
+		period = settings.period;
+		buffer.resize(channels * period);
+		outputs.resize(channels);
+
+		for (size_t c = 0; c < channels; c++) {
+			outputs[c] = buffer.data() + c;
+		}
+	}
+
+	~ALSADevice()
+	{
+		stop();
+		snd_pcm_close(pcm);
+	}
+
+	void start() override
+	{
+		quit = false;
+		snd_pcm_prepare(pcm);
+
+		thread = std::thread([this] {
+			set_realtime_priority();
+
+			while (!quit) {
+				generate(outputs.data(), channels, channels, period);
+
+				for (size_t offset = 0; offset < period;) {
+					auto written = snd_pcm_writei(pcm, buffer.data() + offset * channels, period - offset);
+
+					if (written < 0) {
+						// Recover from underruns, and drop the rest of the period
+						if (written == -EPIPE) {
+							Profiler::xrun();
+						}
+
+						if (snd_pcm_recover(pcm, written, 1) < 0) {
+							return;
+						}
+
+						break;
+					}
+
+					offset += written;
+				}
+			}
+		});
+	}
+
+	void stop() override
+	{
+		if (thread.joinable()) {
+			quit = true;
+			thread.join();
+			snd_pcm_drop(pcm);
+		}
+	}
+};
+
+}
+
+std::unique_ptr<Device> open_alsa(Settings &settings)
+{
+	return std::make_unique<ALSADevice>(settings);
+}
+
+}
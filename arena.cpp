@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "arena.hpp"
+#include "registry.hpp"
+
+#include <algorithm>
+
+namespace ModSynth
+{
+
+namespace
+{
+
+/// Round @p value up to a multiple of @p align, which must be a power of two.
+std::size_t align_up(std::size_t value, std::size_t align)
+{
+	return (value + align - 1) & ~(align - 1);
+}
+
+}
+
+Arena::Arena(std::size_t chunk_size): chunk_size(chunk_size)
+{
+	// Make sure the registry outlives the modules in a static arena
+	Registry::get();
+}
+
+Arena::~Arena()
+{
+	// Chunks are removed in reverse order, so later objects are destroyed first
+	for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
+		remove(*it, (*it)->size, Chunk::destroy);
+	}
+}
+
+/**
+ * Destroy all objects in a chunk, and free its memory.
+ *
+ * @param ptr  A pointer to the chunk.
+ */
+void Arena::Chunk::destroy(void *ptr)
+{
+	auto chunk = static_cast<Chunk *>(ptr);
+
+	for (auto it = chunk->objects.rbegin(); it != chunk->objects.rend(); ++it) {
+		it->second(it->first);
+	}
+
+	chunk->~Chunk();
+	::operator delete(ptr, std::align_val_t{alignment});
+}
+
+/**
+ * Allocate memory for a new object, allocating a new chunk if necessary.
+ *
+ * The memory is claimed right away, so objects constructed by the constructor
+ * of the new object are placed after it.
+ *
+ * @param size        The size of the object.
+ * @param[out] chunk  The chunk the memory belongs to.
+ * @return            A pointer to the memory, aligned to #alignment.
+ */
+void *Arena::allocate(std::size_t size, Chunk *&chunk)
+{
+	if (!chunks.empty()) {
+		chunk = chunks.back();
+		auto offset = align_up(chunk->used, alignment);
+
+		if (offset + size <= chunk->size) {
+			chunk->used = offset + size;
+			return reinterpret_cast<std::byte *>(chunk) + offset;
+		}
+	}
+
+	auto header = align_up(sizeof(Chunk), alignment);
+	auto total = std::max(chunk_size, header + size);
+	auto memory = ::operator new(total, std::align_val_t{alignment});
+	chunk = new (memory) Chunk{total, header + size, {}};
+
+	try {
+		chunks.push_back(chunk);
+	} catch (...) {
+		Chunk::destroy(chunk);
+		throw;
+	}
+
+	return static_cast<std::byte *>(memory) + header;
+}
+
+}
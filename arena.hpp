@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "modsynth.hpp"
+
+/**
+ * @file arena.hpp
+ * @brief Contiguous storage for modules.
+ */
+
+namespace ModSynth
+{
+
+/**
+ * @brief An allocator that stores modules next to each other.
+ *
+ * Modules declared in different places end up scattered throughout memory,
+ * so running them means jumping between unrelated cache lines. An arena
+ * constructs modules, or objects containing modules like voices, one after the
+ * other in large chunks of memory. Since modules are run in order of
+ * registration unless their connections require otherwise, creating them in
+ * the order they process the signal makes the audio thread walk through memory
+ * mostly sequentially. Every object starts at a cache line boundary, so
+ * modules run by different threads never share a cache line.
+ *
+ * Objects are only destroyed when the arena is destroyed, which is safe to do
+ * while the audio output is active.
+ */
+struct Arena {
+	static constexpr std::size_t alignment = 64; ///< The alignment of every object.
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param chunk_size  The size of each chunk of memory, larger objects get a chunk of their own.
+	 */
+	explicit Arena(std::size_t chunk_size = 1 << 20);
+	Arena(const Arena &other) = delete;
+
+	/**
+	 * @brief The destructor.
+	 *
+	 * This removes all the modules in the arena, and destroys all objects in
+	 * reverse order of construction, once the audio thread no longer uses them.
+	 */
+	~Arena();
+
+	/**
+	 * @brief Construct an object in the arena.
+	 *
+	 * @param args  The arguments to pass to the constructor of @p T.
+	 * @return      A reference to the new object.
+	 */
+	template<typename T, typename... Args>
+	T &make(Args &&...args)
+	{
+		static_assert(alignof(T) <= alignment, "the object needs a larger alignment than the arena provides");
+
+		Chunk *chunk;
+		auto object = new (allocate(sizeof(T), chunk)) T(std::forward<Args>(args)...);
+
+		try {
+			chunk->objects.emplace_back(object, [](void *ptr) {
+				static_cast<T *>(ptr)->~T();
+			});
+		} catch (...) {
+			object->~T();
+			throw;
+		}
+
+		return *object;
+	}
+
+private:
+	/**
+	 * A chunk of memory holding objects.
+	 *
+	 * This header is stored at the start of the memory it manages, so the
+	 * whole chunk can be handed to remove() as a single object.
+	 */
+	struct Chunk {
+		std::size_t size;                                      ///< The size of the chunk, including this header.
+		std::size_t used;                                      ///< The number of bytes in use, including this header.
+		std::vector<std::pair<void *, void (*)(void *)>> objects; ///< The objects in this chunk, and how to destroy them.
+
+		static void destroy(void *ptr);
+	};
+
+	void *allocate(std::size_t size, Chunk *&chunk);
+
+	std::size_t chunk_size;     ///< The size of new chunks.
+	std::vector<Chunk *> chunks; ///< The chunks, the last one is filled first.
+};
+
+}
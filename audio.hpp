@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "modsynth.hpp"
+
+namespace ModSynth
+{
+
+/**
+ * @brief An opened audio output device.
+ *
+ * A device has its own thread, or gets called back by the audio driver, from
+ * which it calls generate() whenever it needs more audio. The device is
+ * opened by its constructor, which updates the Settings it is given with the
+ * sample rate and period size it actually uses.
+ */
+struct Device {
+	virtual ~Device() = default;
+
+	virtual void start() = 0; ///< Start calling generate().
+
+	/**
+	 * @brief Stop calling generate().
+	 *
+	 * When this returns, generate() is guaranteed to no longer be running.
+	 */
+	virtual void stop() = 0;
+};
+
+/**
+ * @brief Run the modules and write the generated audio.
+ *
+ * This must only be called from the audio thread.
+ *
+ * @param outputs   For each channel, a pointer to where its first sample must be written.
+ * @param channels  The number of channels.
+ * @param stride    The distance between consecutive samples of a channel.
+ * @param frames    The number of frames to generate.
+ */
+void generate(float *const *outputs, std::size_t channels, std::size_t stride, std::size_t frames);
+
+/**
+ * @brief Open an ALSA PCM device.
+ *
+ * This is only available if ModSynth was compiled with MODSYNTH_ALSA defined.
+ *
+ * @param settings  The settings to open the device with, updated with the actual period size.
+ * @return          The opened device.
+ */
+std::unique_ptr<Device> open_alsa(Settings &settings);
+
+/**
+ * @brief Connect to a JACK server.
+ *
+ * This is only available if ModSynth was compiled with MODSYNTH_JACK defined.
+ * The sample rate and period size are determined by the JACK server.
+ *
+ * @param settings  The settings to open the device with, updated with the actual sample rate and period size.
+ * @return          The opened device.
+ */
+std::unique_ptr<Device> open_jack(Settings &settings);
+
+}
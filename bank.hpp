@@ -0,0 +1,447 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "dsp.hpp"
+#include "modsynth.hpp"
+
+/**
+ * @file bank.hpp
+ * @brief Banks of modules for polyphonic synthesizers.
+ *
+ * A bank implements N copies of a module in a single object. Each copy is
+ * called a voice, and has its own inputs and outputs, which can be connected
+ * just like those of the corresponding single module. The state of all the
+ * voices is stored as a structure of arrays, and the modules are updated by
+ * loops over all the voices at once. Since N is a compile time constant and
+ * the voices are independent of each other, the compiler can vectorize these
+ * loops for whatever SIMD instruction set it is targeting, processing 4, 8 or
+ * 16 voices per instruction. This requires optimization to be enabled, and
+ * with GCC also -fno-trapping-math, without which it does not turn the
+ * selections between floating point results into vector blends. The meson
+ * build enables both.
+ *
+ * Sines are calculated with the same polynomial as VCO::BAND_LIMITED, and the
+ * scratch space of the loops is part of the bank, so it does not have to fit
+ * on the stack of the audio thread. Apart from that, each voice behaves
+ * exactly like the single module.
+ */
+
+namespace ModSynth
+{
+
+/**
+ * @brief The values of N voices for every time step of a block.
+ *
+ * The values of all voices for a single time step are stored next to each
+ * other, so loops over the voices can be vectorized.
+ */
+template<std::size_t N>
+using Lanes = float[Module::max_block_size][N];
+
+/**
+ * @brief Copy the values of N inputs into lanes.
+ *
+ * @param inputs  The inputs to read from.
+ * @param frames  The number of time steps to copy.
+ * @param lanes   The lanes to write to.
+ */
+template<std::size_t N>
+void gather(const Input (&inputs)[N], std::size_t frames, Lanes<N> &lanes)
+{
+	for (std::size_t v = 0; v < N; v++) {
+		for (std::size_t i = 0; i < frames; i++) {
+			lanes[i][v] = inputs[v][i];
+		}
+	}
+}
+
+/**
+ * @brief Copy the values in lanes to N outputs.
+ *
+ * @param lanes    The lanes to read from.
+ * @param frames   The number of time steps to copy.
+ * @param outputs  The outputs to write to.
+ */
+template<std::size_t N>
+void scatter(const Lanes<N> &lanes, std::size_t frames, Output (&outputs)[N])
+{
+	for (std::size_t v = 0; v < N; v++) {
+		for (std::size_t i = 0; i < frames; i++) {
+			outputs[v][i] = lanes[i][v];
+		}
+	}
+}
+
+/**
+ * @brief A bank of N Voltage Controlled Oscillators.
+ *
+ * Each voice behaves like a VCO.
+ */
+template<std::size_t N>
+struct VCOBank: Module {
+	/// @name Inputs
+	///@{
+	Input frequency[N]; ///< The frequency of each oscillator, in Hz.
+	///@}
+
+	/// @name Outputs
+	///@{
+	Output sawtooth_out[N]; ///< Sawtooth (ramp) outputs.
+	Output sine_out[N];     ///< Sine wave outputs.
+	Output square_out[N];   ///< Square wave outputs.
+	Output triangle_out[N]; ///< Triangular wave outputs.
+	///@}
+
+	VCOBank()
+	{
+		for (std::size_t v = 0; v < N; v++) {
+			std::fill_n(sawtooth_out[v].buffer, max_block_size, -1.0f);
+			std::fill_n(square_out[v].buffer, max_block_size, 1.0f);
+		}
+	}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param frequency  The initial frequency of all oscillators, in Hz.
+	 */
+	VCOBank(float frequency): VCOBank()
+	{
+		for (auto &input : this->frequency) {
+			input = frequency;
+		}
+	}
+
+	/// The function that will update the state of this module.
+	void process(std::size_t frames) override
+	{
+		gather(frequency, frames, phases);
+
+		// The phase accumulators depend on the previous time step, so run them for all voices at once
+		const float step = dt;
+		float state[N];
+		std::copy_n(phase, N, state);
+
+		for (std::size_t i = 0; i < frames; i++) {
+			for (std::size_t v = 0; v < N; v++) {
+				state[v] = wrap(state[v] + phases[i][v] * step);
+				phases[i][v] = state[v];
+			}
+		}
+
+		std::copy_n(state, N, phase);
+
+		// The waveforms only depend on the phase of the same time step
+		for (std::size_t i = 0; i < frames; i++) {
+			for (std::size_t v = 0; v < N; v++) {
+				float p = phases[i][v];
+				sawtooth[i][v] = p * 2.0f - 1.0f;
+				sine[i][v] = fast_sine(p);
+				square[i][v] = p > 0.5f ? -1.0f : 1.0f; // std::rint(p) * -2 + 1, rounding 0.5 to even
+				triangle[i][v] = std::abs(p - 0.5f) * 4.0f - 1.0f;
+			}
+		}
+
+		scatter(sawtooth, frames, sawtooth_out);
+		scatter(sine, frames, sine_out);
+		scatter(square, frames, square_out);
+		scatter(triangle, frames, triangle_out);
+	}
+
+	bool block_processing() const override { return true; }
+
+private:
+	// Internal state
+	float phase[N]{}; ///< The current phase of each oscillator, between 0 and 1.
+
+	// Scratch space
+	Lanes<N> phases;   ///< The phases during the current block.
+	Lanes<N> sawtooth; ///< The sawtooth waves during the current block.
+	Lanes<N> sine;     ///< The sine waves during the current block.
+	Lanes<N> square;   ///< The square waves during the current block.
+	Lanes<N> triangle; ///< The triangular waves during the current block.
+};
+
+/**
+ * @brief A bank of N envelope generators.
+ *
+ * Each voice behaves like an Envelope.
+ */
+template<std::size_t N>
+struct EnvelopeBank: Module {
+	/// @name Inputs
+	///@{
+	Input gate_in[N]; ///< Gate inputs, > 0 trigger attack, <= 0 triggers release.
+	Input attack[N];  ///< The attack rise times in seconds.
+	Input decay[N];   ///< The decay times in seconds.
+	Input release[N]; ///< The release times in seconds.
+	///@}
+
+	/// @name Outputs
+	///@{
+	Output amplitude_out[N]; ///< The generated amplitudes.
+	///@}
+
+	EnvelopeBank() = default;
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param attack   The initial attack rise time of all voices in seconds.
+	 * @param decay    The initial decay time of all voices in seconds.
+	 * @param release  The initial release time of all voices in seconds.
+	 */
+	EnvelopeBank(float attack, float decay, float release)
+	{
+		for (std::size_t v = 0; v < N; v++) {
+			this->attack[v] = attack;
+			this->decay[v] = decay;
+			this->release[v] = release;
+		}
+	}
+
+	/// The function that will update the state of this module.
+	void process(std::size_t frames) override
+	{
+		gather(gate_in, frames, gates);
+
+		// If no parameter changes during this block, only derive the coefficients of the first time step
+		bool constant = true;
+
+		for (std::size_t v = 0; v < N; v++) {
+			constant = constant && attack[v].constant() && decay[v].constant() && release[v].constant();
+		}
+
+		const std::size_t rows = constant ? 1 : frames;
+		const std::size_t stride = constant ? 0 : 1;
+
+		// Derive the coefficients while transposing, so the loop below contains no function calls
+		for (std::size_t v = 0; v < N; v++) {
+			for (std::size_t i = 0; i < rows; i++) {
+				attacks[i][v] = attack_steps[v](attack[v][i], [](float time) { return dt / time; });
+				decays[i][v] = decay_factors[v](decay[v][i], [](float time) { return std::exp2(-dt / time); });
+				releases[i][v] = release_factors[v](release[v][i], [](float time) { return std::exp2(-dt / time); });
+			}
+		}
+
+		int states[N];
+		float amplitudes[N];
+		std::copy_n(state, N, states);
+		std::copy_n(amplitude, N, amplitudes);
+
+		for (std::size_t i = 0; i < frames; i++) {
+			for (std::size_t v = 0; v < N; v++) {
+				int s = states[v];
+				float a = amplitudes[v];
+				float gate = gates[i][v];
+				float attack_step = attacks[i * stride][v];
+				float decay_factor = decays[i * stride][v];
+				float release_factor = releases[i * stride][v];
+
+				// Select the results instead of branching, so all voices can be updated together
+				s = gate <= 0.0f ? RELEASE : s == RELEASE ? ATTACK : s;
+
+				float rise = a + attack_step;
+				float fall = a * (s == DECAY ? decay_factor : release_factor);
+				float peak = rise >= 1.0f ? 1.0f : rise;
+				int after = rise >= 1.0f ? DECAY : ATTACK;
+
+				a = s == ATTACK ? peak : fall;
+				a = a < silence ? 0.0f : a;
+				s = s == ATTACK ? after : s;
+
+				states[v] = s;
+				amplitudes[v] = a;
+				gates[i][v] = a;
+			}
+		}
+
+		std::copy_n(states, N, state);
+		std::copy_n(amplitudes, N, amplitude);
+		scatter(gates, frames, amplitude_out);
+	}
+
+	bool block_processing() const override { return true; }
+
+private:
+	// Internal state
+	enum {
+		RELEASE, // First, so zero-initialized voices start in the release phase
+		ATTACK,
+		DECAY,
+	};
+
+	int state[N]{}; ///< The phase in which each envelope generator currently is.
+	float amplitude[N]{}; ///< The current amplitude of each voice.
+	Coefficient attack_steps[N];    ///< The increase in amplitude per time step during the attack.
+	Coefficient decay_factors[N];   ///< The decrease in amplitude per time step during the decay.
+	Coefficient release_factors[N]; ///< The decrease in amplitude per time step during the release.
+
+	// Scratch space
+	Lanes<N> gates;    ///< The gates during the current block, replaced by the amplitudes.
+	Lanes<N> attacks;  ///< The attack steps during the current block.
+	Lanes<N> decays;   ///< The decay factors during the current block.
+	Lanes<N> releases; ///< The release factors during the current block.
+};
+
+/**
+ * @brief A bank of N Value Controlled Amplifiers.
+ *
+ * Each voice behaves like a VCA.
+ */
+template<std::size_t N>
+struct VCABank: Module {
+	/// @name Inputs
+	///@{
+	Input audio_in[N];  ///< The audio input signals.
+	Input amplitude[N]; ///< The amplitudes used for amplifying the #audio_in signals.
+	///@}
+
+	/// @name Outputs
+	///@{
+	Output audio_out[N]; ///< The amplified audio output signals.
+	///@}
+
+	VCABank() = default;
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param amplitude  The initial amplitude of all voices.
+	 */
+	VCABank(float amplitude)
+	{
+		for (auto &input : this->amplitude) {
+			input = amplitude;
+		}
+	}
+
+	/// The function that will update the state of this module.
+	void process(std::size_t frames) override
+	{
+		for (std::size_t v = 0; v < N; v++) {
+			for (std::size_t i = 0; i < frames; i++) {
+				audio_out[v][i] = audio_in[v][i] * amplitude[v][i];
+			}
+		}
+	}
+
+	bool block_processing() const override { return true; }
+};
+
+/**
+ * @brief A bank of N Value Controlled Filters.
+ *
+ * Each voice behaves like a VCF.
+ */
+template<std::size_t N>
+struct VCFBank: Module {
+	/// @name Inputs
+	///@{
+	Input audio_in[N];  ///< The audio input signals.
+	Input cutoff[N];    ///< The cutoff frequencies in Hz.
+	Input resonance[N]; ///< The resonances, 0 for no resonance, higher values produce more resonance.
+	///@}
+
+	/// @name Outputs
+	///@{
+	Output lowpass_out[N];  ///< Lowpass filtered versions of #audio_in.
+	Output bandpass_out[N]; ///< Bandpass filtered versions of #audio_in.
+	Output highpass_out[N]; ///< Highpass filtered versions of #audio_in.
+	///@}
+
+	VCFBank() = default;
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param cutoff     The initial cutoff frequency of all voices, in Hz.
+	 * @param resonance  The initial resonance level of all voices.
+	 */
+	VCFBank(float cutoff, float resonance)
+	{
+		for (std::size_t v = 0; v < N; v++) {
+			this->cutoff[v] = cutoff;
+			this->resonance[v] = resonance;
+		}
+	}
+
+	/// The function that will update the state of this module.
+	void process(std::size_t frames) override
+	{
+		// If no parameter changes during this block, only derive the coefficients of the first time step
+		bool constant = true;
+
+		for (std::size_t v = 0; v < N; v++) {
+			constant = constant && cutoff[v].constant() && resonance[v].constant();
+		}
+
+		const std::size_t rows = constant ? 1 : frames;
+		const std::size_t stride = constant ? 0 : 1;
+
+		gather(cutoff, rows, fs);
+		gather(resonance, rows, qs);
+		gather(audio_in, frames, audio);
+
+		// The coefficients only depend on the inputs of the same time step, sin(pi / 6) is 0.5
+		const float step = dt;
+
+		for (std::size_t i = 0; i < rows; i++) {
+			for (std::size_t v = 0; v < N; v++) {
+				fs[i][v] = 2.0f * fast_sine(std::min(0.5f * fs[i][v] * step, 1.0f / 12));
+				qs[i][v] = 1.0f / qs[i][v];
+			}
+		}
+
+		// The filter state depends on the previous time step, so run it for all voices at once
+		float lowpasses[N];
+		float bandpasses[N];
+		std::copy_n(lowpass, N, lowpasses);
+		std::copy_n(bandpass, N, bandpasses);
+
+		for (std::size_t i = 0; i < frames; i++) {
+			for (std::size_t v = 0; v < N; v++) {
+				float f = fs[i * stride][v];
+				lowpasses[v] += f * bandpasses[v];
+				float highpass = audio[i][v] - qs[i * stride][v] * bandpasses[v] - lowpasses[v];
+				bandpasses[v] += f * highpass;
+
+				lows[i][v] = lowpasses[v];
+				bands[i][v] = bandpasses[v];
+				audio[i][v] = highpass;
+			}
+		}
+
+		// Once a voice has rung out, stop it from decaying into the denormal range
+		for (std::size_t v = 0; v < N; v++) {
+			bool silent = std::abs(lowpasses[v]) < silence && std::abs(bandpasses[v]) < silence;
+			lowpass[v] = silent ? 0.0f : lowpasses[v];
+			bandpass[v] = silent ? 0.0f : bandpasses[v];
+		}
+
+		scatter(lows, frames, lowpass_out);
+		scatter(bands, frames, bandpass_out);
+		scatter(audio, frames, highpass_out);
+	}
+
+	bool block_processing() const override { return true; }
+
+private:
+	// Internal state
+	float lowpass[N]{};  ///< The current lowpass filter state of each voice.
+	float bandpass[N]{}; ///< The current bandpass filter state of each voice.
+
+	// Scratch space
+	Lanes<N> fs;    ///< The frequency coefficients during the current block.
+	Lanes<N> qs;    ///< The damping coefficients during the current block.
+	Lanes<N> audio; ///< The audio inputs during the current block, replaced by the highpass outputs.
+	Lanes<N> lows;  ///< The lowpass outputs during the current block.
+	Lanes<N> bands; ///< The bandpass outputs during the current block.
+};
+
+}
@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bank.hpp"
+#include "cases.hpp"
+#include "modsynth.hpp"
+
+using namespace ModSynth;
+using Cases::time_spent;
+
+/**
+ * @file bench.cpp
+ * @brief Benchmarks of the built-in modules and of complete patches.
+ *
+ * All benchmarks render audio offline, so no sound card is needed. The
+ * results are written to the standard output as CSV, with one line per
+ * benchmark containing the time spent per sample in nanoseconds. For the
+ * module benchmarks, this is the time spent in that module only, as measured
+ * by the profiler. For the patch benchmarks, this is the time spent generating
+ * all the audio, with profiling disabled.
+ */
+
+namespace
+{
+
+/// A sink that discards the rendered audio.
+struct NullSink: Sink {
+	void write(const float *, std::size_t) override {}
+};
+
+float seconds = 1; ///< The amount of audio rendered by each benchmark.
+
+/// Get the number of samples rendered by each benchmark.
+double samples()
+{
+	return seconds / Module::dt;
+}
+
+/**
+ * Write the result of a benchmark.
+ *
+ * @param benchmark  The name of the benchmark.
+ * @param variant    The variant of the benchmark.
+ * @param voices     The number of voices.
+ * @param threads    The number of worker threads.
+ * @param ns         The time spent per sample, in nanoseconds.
+ */
+void report(const std::string &benchmark, const std::string &variant, std::size_t voices, std::size_t threads, double ns)
+{
+	std::cout << benchmark << ',' << variant << ',' << voices << ',' << threads << ',' << ns << std::endl;
+}
+
+/**
+ * Render audio using the currently existing modules.
+ *
+ * @param threads  The number of worker threads to use.
+ * @return         The total time spent per sample, in nanoseconds.
+ */
+double run(std::size_t threads = 0)
+{
+	NullSink sink;
+	Settings settings;
+	settings.threads = threads;
+
+	auto start = std::chrono::steady_clock::now();
+	render(seconds, sink, settings);
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / samples();
+}
+
+/**
+ * Render audio with profiling enabled.
+ */
+void profile_run()
+{
+	set_profiling(true);
+	run();
+	set_profiling(false);
+}
+
+/**
+ * Render audio, and report the time spent in a single module.
+ *
+ * @param benchmark  The name of the benchmark.
+ * @param variant    The variant of the benchmark.
+ * @param mod        The module to measure.
+ */
+void measure(const std::string &benchmark, const std::string &variant, const Module &mod)
+{
+	auto before = time_spent(mod);
+	profile_run();
+	report(benchmark, variant, 1, 0, (time_spent(mod) - before) / samples());
+}
+
+/**
+ * Benchmark a case.
+ *
+ * Module cases report the time spent in the measured module, other cases the
+ * time spent rendering the whole patch.
+ */
+void bench(const std::string &benchmark, const std::string &variant, const Module *mod)
+{
+	if (mod) {
+		measure(benchmark, variant, *mod);
+	} else {
+		report(benchmark, variant, 1, 0, run());
+	}
+}
+
+/**
+ * Benchmark an increasing number of voices, with and without worker threads or sleeping voices.
+ *
+ * The voices share a clock, which runs before them, after which every voice is
+ * a task of its own. The parallel variant uses one worker thread per
+ * additional core, but always at least one, so every host reports the same
+ * rows.
+ */
+void bench_voices()
+{
+	std::size_t threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 2) - 1;
+
+	for (std::size_t voices = 1; voices <= 256; voices *= 2) {
+		Cases::voices([&](const std::string &benchmark, const std::string &variant, const Module *) {
+			report(benchmark, variant, voices, 0, run());
+
+			if (variant == "serial") {
+				report(benchmark, "parallel", voices, threads, run(threads));
+			}
+		}, voices);
+	}
+}
+
+/// The modules of a voice that banks implement, as single modules.
+struct SingleVoice {
+	VCO vco;
+	Envelope envelope{0.01, 0.5, 0.1};
+	VCF vcf{0, 3};
+	VCA vca;
+	Speaker speaker;
+
+	SingleVoice(float frequency, const Output &gate)
+	{
+		vco.frequency = frequency;
+		vcf.cutoff = 4 * frequency;
+		envelope.gate_in.connect(gate);
+		vcf.audio_in.connect(vco.sawtooth_out);
+		vca.audio_in.connect(vcf.lowpass_out);
+		vca.amplitude.connect(envelope.amplitude_out);
+		speaker.left_in.connect(vca.audio_out);
+		speaker.right_in.connect(vco.sine_out);
+	}
+};
+
+/// The same modules of N voices, as banks.
+template<std::size_t N>
+struct BankVoices {
+	VCOBank<N> vco;
+	EnvelopeBank<N> envelope{0.01, 0.5, 0.1};
+	VCFBank<N> vcf{0, 3};
+	VCABank<N> vca;
+	Speaker speaker[N];
+
+	BankVoices(const Output &gate)
+	{
+		for (std::size_t v = 0; v < N; v++) {
+			vco.frequency[v] = 110.0f * (1 + v % 12 / 12.0f);
+			vcf.cutoff[v] = 4 * vco.frequency[v];
+			envelope.gate_in[v].connect(gate);
+			vcf.audio_in[v].connect(vco.sawtooth_out[v]);
+			vca.audio_in[v].connect(vcf.lowpass_out[v]);
+			vca.amplitude[v].connect(envelope.amplitude_out[v]);
+			speaker[v].left_in.connect(vca.audio_out[v]);
+			speaker[v].right_in.connect(vco.sine_out[v]);
+		}
+	}
+};
+
+/// Benchmark N voices of each module that has a bank, as N single modules and as one bank.
+template<std::size_t N>
+void bench_banks()
+{
+	{
+		VCO clock{4};
+		std::vector<std::unique_ptr<SingleVoice>> voices;
+
+		for (std::size_t v = 0; v < N; v++) {
+			voices.push_back(std::make_unique<SingleVoice>(110.0f * (1 + v % 12 / 12.0f), clock.square_out));
+		}
+
+		// Add up the time spent in the single modules of the same type
+		auto total = [&voices](auto member) {
+			double result = 0;
+
+			for (auto &voice : voices) {
+				result += time_spent(*voice.*member);
+			}
+
+			return result;
+		};
+
+		double before[] = {total(&SingleVoice::vco), total(&SingleVoice::envelope), total(&SingleVoice::vcf), total(&SingleVoice::vca)};
+		profile_run();
+		report("VCOBank", "single", N, 0, (total(&SingleVoice::vco) - before[0]) / samples());
+		report("EnvelopeBank", "single", N, 0, (total(&SingleVoice::envelope) - before[1]) / samples());
+		report("VCFBank", "single", N, 0, (total(&SingleVoice::vcf) - before[2]) / samples());
+		report("VCABank", "single", N, 0, (total(&SingleVoice::vca) - before[3]) / samples());
+	}
+
+	{
+		VCO clock{4};
+		auto banks = std::make_unique<BankVoices<N>>(clock.square_out);
+
+		double before[] = {time_spent(banks->vco), time_spent(banks->envelope), time_spent(banks->vcf), time_spent(banks->vca)};
+		profile_run();
+		report("VCOBank", "bank", N, 0, (time_spent(banks->vco) - before[0]) / samples());
+		report("EnvelopeBank", "bank", N, 0, (time_spent(banks->envelope) - before[1]) / samples());
+		report("VCFBank", "bank", N, 0, (time_spent(banks->vcf) - before[2]) / samples());
+		report("VCABank", "bank", N, 0, (time_spent(banks->vca) - before[3]) / samples());
+	}
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 2 || (argc == 2 && (seconds = std::atof(argv[1])) <= 0)) {
+		std::cerr << "Usage: " << argv[0] << " [seconds]\n";
+		return 1;
+	}
+
+	std::cout << "benchmark,variant,voices,threads,ns_per_sample\n";
+
+	Cases::modules(bench);
+	bench_voices();
+	bench_banks<8>();
+	bench_banks<32>();
+	Cases::example(bench, false);
+	Cases::example(bench, true);
+}
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "graph.hpp"
+#include "modsynth.hpp"
+
+/**
+ * @file cases.hpp
+ * @brief The patches rendered by both the benchmarks and the golden checks.
+ *
+ * Every case is a small patch around one of the built-in modules, or a
+ * complete patch. A case constructs and connects its modules, and then calls
+ * a function to render them, once for every variant of the case. That
+ * function decides what to do with the rendered audio, so the benchmarks only
+ * time it, while the golden checks compare it with a recording.
+ */
+
+namespace Cases
+{
+
+using namespace ModSynth;
+
+/**
+ * @brief The function that renders the currently existing modules.
+ *
+ * @param benchmark  The name of the case, which is the type of the measured module for module cases.
+ * @param variant    The name of the variant of the case.
+ * @param mod        The module to measure the time of, or nullptr to measure the whole patch.
+ */
+using Run = std::function<void(const std::string &benchmark, const std::string &variant, const Module *mod)>;
+
+/**
+ * Get the time spent in a module so far.
+ *
+ * @param mod  The module.
+ * @return     The total time spent running the module, in nanoseconds.
+ */
+inline double time_spent(const Module &mod)
+{
+	for (auto &stats : profile().modules) {
+		if (stats.module == &mod) {
+			return stats.time;
+		}
+	}
+
+	return 0;
+}
+
+/// The oscillators.
+inline void vco(const Run &run)
+{
+	for (auto [mode, name] : {std::pair{VCO::NAIVE, "naive"}, {VCO::BAND_LIMITED, "band_limited"}}) {
+		VCO vco{440, mode};
+		Speaker speaker;
+		speaker.left_in.connect(vco.sawtooth_out);
+		speaker.right_in.connect(vco.square_out);
+		run("VCO", std::string(name) + "_sawtooth_square", &vco);
+
+		speaker.left_in.connect(vco.sine_out);
+		speaker.right_in.connect(vco.triangle_out);
+		run("VCO", std::string(name) + "_sine_triangle", &vco);
+	}
+}
+
+/// The filter, fed with a sawtooth wave.
+inline void vcf(const Run &run)
+{
+	VCO vco{110};
+	VCF vcf{1000, 3};
+	Speaker speaker;
+	vcf.audio_in.connect(vco.sawtooth_out);
+	speaker.left_in.connect(vcf.lowpass_out);
+	speaker.right_in.connect(vcf.highpass_out);
+	run("VCF", "constant_cutoff", &vcf);
+
+	// Sweep the cutoff frequency, so the coefficients are recalculated every time step
+	VCO clock{2};
+	Envelope sweep{0.2, 1, 0.2};
+	VCA depth{2000};
+	sweep.gate_in.connect(clock.square_out);
+	depth.audio_in.connect(sweep.amplitude_out);
+	vcf.cutoff.connect(depth.audio_out);
+	speaker.right_in.connect(vcf.bandpass_out);
+	run("VCF", "modulated_cutoff", &vcf);
+}
+
+/// The envelope generator, triggered at a regular interval.
+inline void envelope(const Run &run)
+{
+	VCO clock{4};
+	Envelope envelope{0.01, 1, 0.1};
+	Speaker speaker;
+	envelope.gate_in.connect(clock.square_out);
+	speaker.left_in.connect(envelope.amplitude_out);
+	run("Envelope", "gated", &envelope);
+}
+
+/// The amplifier.
+inline void vca(const Run &run)
+{
+	VCO vco{440};
+	VCO lfo{1};
+	VCA vca;
+	Speaker speaker;
+	vca.audio_in.connect(vco.sine_out);
+	vca.amplitude.connect(lfo.triangle_out);
+	speaker.left_in.connect(vca.audio_out);
+	run("VCA", "modulated", &vca);
+}
+
+/// The delays with all interpolation methods.
+inline void delay(const Run &run)
+{
+	for (auto [interpolation, name] : {
+		std::pair{Interpolation::NONE, "none"},
+		{Interpolation::LINEAR, "linear"},
+		{Interpolation::CUBIC, "cubic"},
+		{Interpolation::ALLPASS, "allpass"},
+	}) {
+		VCO vco{440};
+		Delay delay{1, interpolation};
+		Speaker speaker;
+		delay.in.connect(vco.sine_out);
+		delay.delay = 0.1234f;
+		speaker.left_in.connect(delay.out);
+		run("Delay", name, &delay);
+
+		MultiTapDelay taps{4, 1, interpolation};
+		taps.in.connect(vco.sine_out);
+
+		for (std::size_t i = 0; i < taps.delay.size(); i++) {
+			taps.delay[i] = 0.1f * (i + 1) + 0.0123f;
+		}
+
+		speaker.left_in.connect(taps.out[0]);
+		speaker.right_in.connect(taps.out[3]);
+		run("MultiTapDelay", name, &taps);
+	}
+}
+
+/// The filter with a high cutoff frequency, oversampled.
+inline void oversampler(const Run &run)
+{
+	for (std::size_t factor : {2, 4, 8}) {
+		VCO vco{110};
+		VCF vcf{15000, 3};
+		Oversampler oversampler{factor, 1, 1, {&vcf}};
+		Speaker speaker;
+		oversampler.in[0].connect(vco.sawtooth_out);
+		vcf.audio_in.connect(oversampler.inner_in[0]);
+		oversampler.inner_out[0].connect(vcf.lowpass_out);
+		speaker.left_in.connect(oversampler.out[0]);
+		run("Oversampler", "vcf_" + std::to_string(factor) + "x", &oversampler);
+	}
+}
+
+/// The envelope generator run at the control rate, including the interpolation.
+inline void control_rate(const Run &run)
+{
+	for (std::size_t factor : {8, 32}) {
+		VCO clock{4};
+		Envelope envelope{0.01, 1, 0.1};
+		ControlRate control{factor, 1, 1, {&envelope}};
+		Speaker speaker;
+		control.in[0].connect(clock.square_out);
+		envelope.gate_in.connect(control.inner_in[0]);
+		control.inner_out[0].connect(envelope.amplitude_out);
+		speaker.left_in.connect(control.out[0]);
+		run("ControlRate", "envelope_" + std::to_string(factor) + "x", &control);
+	}
+}
+
+/// The sequencer, clocked at a regular interval or by its own tempo.
+inline void sequencer(const Run &run)
+{
+	VCO clock{8};
+	Sequencer sequencer{"C4", "E4", "G4", "C5"};
+	Speaker speaker;
+	sequencer.clock_in.connect(clock.square_out);
+	speaker.left_in.connect(sequencer.frequency_out);
+	speaker.right_in.connect(sequencer.gate_out);
+	run("Sequencer", "clocked", &sequencer);
+
+	sequencer.tempo = 480;
+	run("Sequencer", "tempo", &sequencer);
+}
+
+/// The slew limiters, following a square wave.
+inline void slew(const Run &run)
+{
+	VCO vco{50};
+	LinearSlew linear{100};
+	ExponentialSlew exponential{3, 100};
+	Speaker speaker;
+	linear.in.connect(vco.square_out);
+	exponential.in.connect(vco.square_out);
+	speaker.left_in.connect(linear.out);
+	run("LinearSlew", "square", &linear);
+
+	speaker.left_in.connect(exponential.out);
+	run("ExponentialSlew", "square", &exponential);
+}
+
+/// All the cases around a single built-in module.
+inline void modules(const Run &run)
+{
+	vco(run);
+	vcf(run);
+	envelope(run);
+	vca(run);
+	delay(run);
+	oversampler(run);
+	control_rate(run);
+	sequencer(run);
+	slew(run);
+}
+
+/// A subtractive synthesizer voice.
+struct Voice {
+	VCO vco;
+	Envelope envelope{0.01, 0.5, 0.1};
+	VCA vca;
+	VCF vcf{0, 3};
+	VCA cutoff{2000};
+	Speaker speaker;
+
+	Voice(float frequency, const Output &gate, bool sleep = false)
+	{
+		vco.frequency = frequency;
+		envelope.gate_in.connect(gate);
+		cutoff.audio_in.connect(envelope.amplitude_out);
+		vcf.cutoff.connect(cutoff.audio_out);
+		vcf.audio_in.connect(vco.sawtooth_out);
+		vca.audio_in.connect(vcf.lowpass_out);
+		vca.amplitude.connect(envelope.amplitude_out);
+		speaker.left_in.connect(vca.audio_out);
+		speaker.right_in.connect(vca.audio_out);
+
+		if (sleep) {
+			sleep_while_idle(envelope, {&vco, &vca, &vcf, &cutoff, &speaker});
+		}
+	}
+};
+
+/**
+ * Voices gated by a shared clock, stored separately, next to each other, or mostly sleeping.
+ *
+ * Apart from the clock, the voices do not depend on each other, so worker
+ * threads can run them in parallel.
+ *
+ * @param run     The function rendering each variant.
+ * @param voices  The number of voices, of which only one in eight is playing in the sleeping variant.
+ */
+inline void voices(const Run &run, std::size_t voices)
+{
+	{
+		VCO clock{4};
+		std::vector<std::unique_ptr<Voice>> bank;
+
+		for (std::size_t i = 0; i < voices; i++) {
+			bank.push_back(std::make_unique<Voice>(110.0f * (1 + i % 12 / 12.0f), clock.square_out));
+		}
+
+		run("voices", "serial", nullptr);
+	}
+
+	{
+		VCO clock{4};
+		Arena arena;
+
+		for (std::size_t i = 0; i < voices; i++) {
+			arena.make<Voice>(110.0f * (1 + i % 12 / 12.0f), clock.square_out);
+		}
+
+		run("voices", "arena", nullptr);
+	}
+
+	if (voices >= 8) {
+		VCO clock{4};
+		VCO off{0};
+		std::vector<std::unique_ptr<Voice>> bank;
+
+		for (std::size_t i = 0; i < voices; i++) {
+			bank.push_back(std::make_unique<Voice>(110.0f * (1 + i % 12 / 12.0f), i % 8 ? off.sine_out : clock.square_out, true));
+		}
+
+		run("voices", "sleeping", nullptr);
+	}
+}
+
+/**
+ * The patch from example.cpp.
+ *
+ * @param run    The function rendering the patch.
+ * @param fixed  Whether to schedule the modules at compile time using a StaticGraph.
+ */
+inline void example(const Run &run, bool fixed)
+{
+	VCO clock{1};
+	Sequencer sequencer{"C2", "D2", "Bb1", "F1"};
+	VCO vco;
+	VCF vcf{0, 3};
+	VCA vca{2000};
+	Envelope envelope{0.1, 1, 0.1};
+	Speaker speaker;
+
+	Wire wires[] {
+		{clock.square_out,        sequencer.clock_in},
+		{sequencer.gate_out,      envelope.gate_in},
+		{sequencer.frequency_out, vco.frequency},
+		{envelope.amplitude_out,  vca.audio_in},
+		{vca.audio_out,           vcf.cutoff},
+		{vco.sawtooth_out,        vcf.audio_in},
+		{vcf.lowpass_out,         speaker.left_in},
+		{vcf.lowpass_out,         speaker.right_in},
+	};
+
+	if (fixed) {
+		StaticGraph graph{clock, sequencer, envelope, vco, vca, vcf, speaker};
+		run("example", "static_graph", nullptr);
+	} else {
+		run("example", "patch", nullptr);
+	}
+}
+
+}
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cmath>
+
+/**
+ * @file dsp.hpp
+ * @brief Signal processing functions shared by the modules and the banks.
+ *
+ * These are defined inline, so loops calling them can be vectorized.
+ */
+
+namespace ModSynth
+{
+
+/// The ratio of the circumference of a circle to its diameter.
+inline constexpr float pi = 3.14159265358979f;
+
+/**
+ * Calculate the fractional part of a phase, like phase - std::floor(phase).
+ *
+ * Unlike std::floor(), this can be vectorized without SSE4.1 as well.
+ *
+ * @param phase  The phase, with a magnitude less than 2^31.
+ * @return       The phase wrapped to [0, 1).
+ */
+inline float wrap(float phase)
+{
+	// Truncate, and correct the result for negative phases without branching
+	int whole = static_cast<int>(phase);
+	whole -= phase < static_cast<float>(whole);
+	return phase - static_cast<float>(whole);
+}
+
+/**
+ * Calculate sin(2 pi phase) using a polynomial approximation.
+ *
+ * The phase is folded into a quarter period, where a Taylor series up to the
+ * 11th power is accurate to better than 1e-7. It contains no branches or
+ * function calls that cannot be vectorized.
+ *
+ * @param phase  The phase, between -0.75 and 1.25.
+ * @return       The sine of the given phase.
+ */
+inline float fast_sine(float phase)
+{
+	// Map to [-0.25, 0.25] and use sin(2 pi (0.5 - x)) = sin(2 pi x)
+	float x = phase - 0.5f;
+	float folded = std::copysign(0.5f, x) - x;
+	x = std::abs(x) > 0.25f ? folded : x;
+
+	float y = x * 2.0f * pi;
+	float y2 = y * y;
+	float result = y * (1.0f + y2 * (-1.0f / 6 + y2 * (1.0f / 120 + y2 * (-1.0f / 5040 + y2 * (1.0f / 362880 + y2 * (-1.0f / 39916800))))));
+
+	// sin(2 pi (x + 0.5)) = -sin(2 pi x)
+	return -result;
+}
+
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "modsynth.hpp"
+#include "file.hpp"
+#include "stream.hpp"
+
+using namespace ModSynth;
+
+/// A sink that discards the audio of a process that streams its signals instead.
+struct Discard: Sink {
+	void write(const float *, std::size_t) override {}
+};
+
+/**
+ * Render a pad in a separate process, and stream it to the main process.
+ *
+ * On another host, the file descriptor would come from connect_tcp() instead.
+ */
+void render_pad(int fd)
+{
+	Stream stream{fd};
+	Discard discard;
+
+	// Components
+	VCO vcos[] {{220}, {277.18f}, {329.63f}};
+	VCF vcf{800, 1};
+	VCA vca{0.5};
+	Sender sender{stream, 2};
+
+	// Routing
+	Wire wires[] {
+		{vcos[0].sawtooth_out, vcf.audio_in},
+		{vcf.lowpass_out,      vca.audio_in},
+		{vca.audio_out,        sender.in[0]},
+		{vcos[1].triangle_out, sender.in[1]},
+	};
+
+	render(4, discard);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		std::cerr << "Usage: " << argv[0] << " output.wav\n";
+		return 1;
+	}
+
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		std::cerr << "Could not create a socket pair\n";
+		return 1;
+	}
+
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		close(fds[0]);
+		render_pad(fds[1]);
+		return 0;
+	}
+
+	close(fds[1]);
+	Stream stream{fds[0]};
+
+	// Components
+	VCO clock{1};
+	Sequencer sequencer{"C2", "D2", "Bb1", "F1"};
+	VCO vco;
+	VCF vcf{0, 3};
+	VCA vca{2000};
+	Envelope envelope{0.1, 1, 0.1};
+	Receiver pad{stream, 2};
+	Speaker speaker;
+	Speaker pad_speaker;
+
+	// Routing
+	Wire wires[] {
+		{clock.square_out,        sequencer.clock_in},
+		{sequencer.gate_out,      envelope.gate_in},
+		{sequencer.frequency_out, vco.frequency},
+		{envelope.amplitude_out,  vca.audio_in},
+		{vca.audio_out,           vcf.cutoff},
+		{vco.sawtooth_out,        vcf.audio_in},
+		{vcf.lowpass_out,         speaker.left_in},
+		{vcf.lowpass_out,         speaker.right_in},
+		{pad.out[0],              pad_speaker.left_in},
+		{pad.out[1],              pad_speaker.right_in},
+	};
+
+	// Mix the two processes into one file
+	WAVWriter writer{argv[1]};
+	render(4, writer);
+	waitpid(pid, nullptr, 0);
+}
@@ -1,33 +1,50 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <iostream>
+#include <memory>
+#include <vector>
 #include "modsynth.hpp"
 #include "midi.hpp"
 
 using namespace ModSynth;
 
-int main()
-{
+struct Voice {
 	// Components
-	MIDI midi;
 	VCO vco;
 	VCF vcf{0, 3};
 	VCA vca{2000};
 	Envelope envelope{0.1, 1, 0.1};
 	Speaker speaker;
 
-	// Routing
-	Wire wires[] {
-		{midi.channels[0].gate,      envelope.gate_in},
-		{midi.channels[0].frequency, vco.frequency},
-		{envelope.amplitude_out,     vca.audio_in},
-		{vca.audio_out,              vcf.cutoff},
-		{vco.sawtooth_out,           vcf.audio_in},
-		{vcf.lowpass_out,            speaker.left_in},
-		{vcf.lowpass_out,            speaker.right_in},
-	};
+	Voice(MIDI::Voice &voice)
+	{
+		// Routing
+		envelope.gate_in.connect(voice.gate);
+		vco.frequency.connect(voice.frequency);
+		vca.audio_in.connect(envelope.amplitude_out);
+		vcf.cutoff.connect(vca.audio_out);
+		vcf.audio_in.connect(vco.sawtooth_out);
+		speaker.left_in.connect(vcf.lowpass_out);
+		speaker.right_in.connect(vcf.lowpass_out);
+
+		// Steal the quietest voice, and don't spend any time on voices that are not playing
+		voice.level.connect(envelope.amplitude_out);
+		sleep_while_idle(envelope, {&vco, &vcf, &vca, &speaker});
+	}
+};
+
+int main()
+{
+	// Components
+	MIDI midi{"modsynth", 8, MIDI::QUIETEST};
+	std::vector<std::unique_ptr<Voice>> voices;
+
+	for (auto &voice : midi.channels[0].voices) {
+		voices.push_back(std::make_unique<Voice>(voice));
+	}
 
 	start();
 	std::cout << "Press enter to exit...\n";
 	std::cin.get();
+	stop();
 }
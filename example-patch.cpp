@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "modsynth.hpp"
+#include "patch.hpp"
+
+using namespace ModSynth;
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || argc > 3) {
+		std::cerr << "Usage: " << argv[0] << " patch [output.bin]\n";
+		return 1;
+	}
+
+	// Convert the patch to the binary format
+	if (argc == 3) {
+		std::ofstream file(argv[2], std::ios::binary);
+		write_patch(file, load_patch(argv[1]));
+		return 0;
+	}
+
+	Patch patch{load_patch(argv[1])};
+
+	start();
+	std::cout << "Press enter to reload " << argv[1] << ", or q and enter to exit...\n";
+
+	// Reload the patch while it is playing, keeping the state of modules that did not change
+	for (std::string line; std::getline(std::cin, line) && line != "q";) {
+		try {
+			patch.load(load_patch(argv[1]));
+		} catch (std::exception &e) {
+			std::cerr << e.what() << '\n';
+		}
+	}
+
+	stop();
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <iostream>
+#include "modsynth.hpp"
+#include "file.hpp"
+
+using namespace ModSynth;
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		std::cerr << "Usage: " << argv[0] << " output.wav\n";
+		return 1;
+	}
+
+	// Components
+	VCO clock{1};
+	Sequencer sequencer{"C2", "D2", "Bb1", "F1"};
+	VCO vco;
+	VCF vcf{0, 3};
+	VCA vca{2000};
+	Envelope envelope{0.1, 1, 0.1};
+	Speaker speaker;
+
+	// Routing
+	Wire wires[] {
+		{clock.square_out,        sequencer.clock_in},
+		{sequencer.gate_out,      envelope.gate_in},
+		{sequencer.frequency_out, vco.frequency},
+		{envelope.amplitude_out,  vca.audio_in},
+		{vca.audio_out,           vcf.cutoff},
+		{vco.sawtooth_out,        vcf.audio_in},
+		{vcf.lowpass_out,         speaker.left_in},
+		{vcf.lowpass_out,         speaker.right_in},
+	};
+
+	// Render one cycle of the sequence
+	WAVWriter writer{argv[1]};
+	render(4, writer);
+}
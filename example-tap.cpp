@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "modsynth.hpp"
+#include "tap.hpp"
+
+using namespace ModSynth;
+
+/// Print the level of each channel of a running synthesizer ten times per second.
+void meter(const std::string &name)
+{
+	TapReader tap{name};
+	std::vector<float> buffer(tap.sample_rate() / 10);
+	std::uint64_t last = 0;
+
+	// Stop when nothing was written for a second
+	for (int idle = 0; idle < 10; std::this_thread::sleep_for(std::chrono::milliseconds(100))) {
+		auto position = tap.position();
+
+		if (position == last || position < buffer.size()) {
+			idle++;
+			continue;
+		}
+
+		idle = 0;
+		last = position;
+
+		for (size_t c = 0; c < tap.channels(); c++) {
+			float sum = 0;
+
+			if (!tap.read(c, position - buffer.size(), buffer.data(), buffer.size())) {
+				continue;
+			}
+
+			for (auto sample : buffer) {
+				sum += sample * sample;
+			}
+
+			std::printf("%8.1f dB", 10 * std::log10(sum / buffer.size() + 1e-10f));
+		}
+
+		std::printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 3 && argv[1] == std::string("meter")) {
+		meter(argv[2]);
+		return 0;
+	} else if (argc != 1) {
+		std::cerr << "Usage: " << argv[0] << " [meter /modsynth-mix|/modsynth-envelope]\n";
+		return 1;
+	}
+
+	// Components
+	VCO clock{1};
+	Sequencer sequencer{"C2", "D2", "Bb1", "F1"};
+	VCO vco;
+	VCF vcf{0, 3};
+	VCA vca{2000};
+	Envelope envelope{0.1, 1, 0.1};
+	Speaker speaker;
+	Tap envelope_tap{"/modsynth-envelope", 1};
+
+	// Routing
+	Wire wires[] {
+		{clock.square_out,        sequencer.clock_in},
+		{sequencer.gate_out,      envelope.gate_in},
+		{sequencer.frequency_out, vco.frequency},
+		{envelope.amplitude_out,  vca.audio_in},
+		{envelope.amplitude_out,  envelope_tap.in[0]},
+		{vca.audio_out,           vcf.cutoff},
+		{vco.sawtooth_out,        vcf.audio_in},
+		{vcf.lowpass_out,         speaker.left_in},
+		{vcf.lowpass_out,         speaker.right_in},
+	};
+
+	// Let other processes see what is being played
+	TapBuffer mix_tap{"/modsynth-mix", 2};
+
+	start();
+	tap_mix(&mix_tap);
+	std::cout << "Run " << argv[0] << " meter /modsynth-mix in another terminal to see the levels.\n";
+	std::cout << "Press enter to exit...\n";
+	std::cin.get();
+	stop();
+}
@@ -58,4 +58,5 @@ int main()
 	start();
 	std::cout << "Press enter to exit...\n";
 	std::cin.get();
+	stop();
 }
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "executor.hpp"
+#include "profile.hpp"
+
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+namespace ModSynth
+{
+
+/**
+ * Try to give the calling thread real-time priority.
+ *
+ * This will silently fail if the user is not allowed to use real-time
+ * scheduling, in which case the thread keeps running at normal priority.
+ */
+void set_realtime_priority()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	sched_param param{};
+	param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2;
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+
+/**
+ * Make the calling thread flush denormal numbers to zero.
+ *
+ * On x86 this sets the FTZ and DAZ bits of the MXCSR register, on AArch64 it
+ * sets the FZ bit of the FPCR register. On other architectures this does
+ * nothing.
+ */
+DenormalGuard::DenormalGuard()
+{
+#if defined(__SSE__) || defined(_M_X64)
+	saved = _mm_getcsr();
+	_mm_setcsr(saved | 0x8040);
+#elif defined(__aarch64__)
+	asm volatile("mrs %0, fpcr" : "=r"(saved));
+	asm volatile("msr fpcr, %0" : : "r"(saved | 1 << 24));
+#endif
+}
+
+/**
+ * Restore the previous handling of denormal numbers.
+ */
+DenormalGuard::~DenormalGuard()
+{
+#if defined(__SSE__) || defined(_M_X64)
+	_mm_setcsr(saved);
+#elif defined(__aarch64__)
+	asm volatile("msr fpcr, %0" : : "r"(saved));
+#endif
+}
+
+Executor::~Executor()
+{
+	stop();
+}
+
+/**
+ * Start the worker threads.
+ *
+ * This must not be called while run() is being called from another thread.
+ *
+ * @param threads  The number of worker threads to start.
+ */
+void Executor::start(std::size_t threads)
+{
+	stop();
+
+	participants = std::min(threads, max_participants - 1) + 1;
+	quit = false;
+
+	// The threads might only start running after the first block or stop(), so they must not miss those
+	auto seen = epoch.load(std::memory_order_acquire);
+
+	for (std::size_t i = 1; i < participants; i++) {
+		workers.emplace_back(&Executor::work, this, i, seen);
+	}
+}
+
+/**
+ * Stop the worker threads.
+ *
+ * This must not be called while run() is being called from another thread.
+ */
+void Executor::stop()
+{
+	quit = true;
+	epoch.fetch_add(1);
+	epoch.notify_all();
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	workers.clear();
+	participants = 1;
+}
+
+/**
+ * Run tasks using all the worker threads.
+ *
+ * This returns when all the tasks have finished.
+ *
+ * @param modules  The modules referred to by the tasks.
+ * @param tasks    The tasks to run.
+ * @param count    The number of tasks.
+ * @param frames   The number of frames each module should process.
+ */
+void Executor::run(Module *const *modules, const Task *tasks, std::size_t count, std::size_t frames)
+{
+	if (!count) {
+		return;
+	}
+
+	// Waking up the worker threads for a single task only adds latency
+	if (count == 1) {
+		for (auto j = tasks->begin; j < tasks->end; j++) {
+			if (!modules[j]->asleep()) {
+				Profiler::process(modules[j], frames);
+			}
+		}
+
+		return;
+	}
+
+	this->modules = modules;
+	this->tasks = tasks;
+	this->frames = frames;
+	this->dt = Module::dt;
+	remaining.store(count, std::memory_order_relaxed);
+
+	// Divide the tasks evenly over all participating threads
+	for (std::size_t i = 0; i < participants; i++) {
+		std::uint64_t begin = count * i / participants;
+		std::uint64_t end = count * (i + 1) / participants;
+		queues[i].range.store(begin | end << 32, std::memory_order_release);
+	}
+
+	epoch.fetch_add(1, std::memory_order_release);
+	epoch.notify_all();
+
+	participate(0);
+
+	while (remaining.load(std::memory_order_acquire)) {
+		// Wait for the other threads to finish their tasks
+	}
+}
+
+/**
+ * The main loop of a worker thread.
+ *
+ * @param self  The index of the queue of this thread.
+ * @param seen  The value of #epoch when the thread was started.
+ */
+void Executor::work(std::size_t self, std::uint32_t seen)
+{
+	set_realtime_priority();
+	DenormalGuard denormals;
+	participant = self;
+
+	while (true) {
+		epoch.wait(seen, std::memory_order_acquire);
+		seen = epoch.load(std::memory_order_acquire);
+
+		if (quit) {
+			break;
+		}
+
+		participate(self);
+	}
+}
+
+/**
+ * Run tasks until no more tasks can be claimed.
+ *
+ * This first runs the tasks from the thread's own queue, and then tries to
+ * steal tasks from the queues of the other threads.
+ *
+ * @param self  The index of the queue of the calling thread.
+ */
+void Executor::participate(std::size_t self)
+{
+	for (std::size_t i = 0; i < participants; i++) {
+		auto &queue = queues[(self + i) % participants];
+
+		while (true) {
+			auto range = queue.range.fetch_add(1, std::memory_order_acq_rel);
+			auto next = range & 0xffffffff;
+			auto end = range >> 32;
+
+			if (next >= end) {
+				break;
+			}
+
+			auto &task = tasks[next];
+
+			// The time step is thread-local, make sure it matches that of the calling thread
+			Module::dt = dt;
+
+			for (auto j = task.begin; j < task.end; j++) {
+				if (!modules[j]->asleep()) {
+					Profiler::process(modules[j], frames);
+				}
+			}
+
+			remaining.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+}
+
+}
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "modsynth.hpp"
+
+namespace ModSynth
+{
+
+/**
+ * A pool of worker threads that runs independent groups of modules in parallel.
+ *
+ * The threads are started in advance. For every block, the tasks are divided
+ * evenly over the worker threads and the calling thread. When a thread has run
+ * all its own tasks, it steals tasks from the others. Tasks are claimed using
+ * atomic operations only, and the calling thread busy-waits until all tasks
+ * are finished, so run() never allocates memory or takes a lock.
+ */
+struct Executor {
+	/**
+	 * A task, which is a range of modules that have to be run in order.
+	 */
+	struct Task {
+		std::size_t begin; ///< The index of the first module of this task.
+		std::size_t end;   ///< The index one past the last module of this task.
+	};
+
+	Executor() = default;
+	Executor(const Executor &other) = delete;
+	~Executor();
+
+	void start(std::size_t threads);
+	void stop();
+
+	/**
+	 * Get the number of worker threads.
+	 *
+	 * @return The number of worker threads, or zero if the executor is not started.
+	 */
+	std::size_t threads() const
+	{
+		return workers.size();
+	}
+
+	void run(Module *const *modules, const Task *tasks, std::size_t count, std::size_t frames);
+
+	/**
+	 * The index of the calling thread among the threads running modules.
+	 *
+	 * This is zero for the thread calling run(), and between one and
+	 * threads() for the worker threads. Modules can use this to give every
+	 * thread its own copy of shared state.
+	 */
+	static inline thread_local std::size_t participant{};
+
+private:
+	/// The maximum number of threads taking part in running the tasks, including the calling thread.
+	static constexpr std::size_t max_participants = 64;
+
+	/**
+	 * The tasks assigned to one thread.
+	 *
+	 * The index of the next task to claim is stored in the lower 32 bits, the
+	 * index one past the last task is stored in the upper 32 bits, so both can
+	 * be updated atomically together.
+	 */
+	struct alignas(64) Queue {
+		std::atomic<std::uint64_t> range{};
+	};
+
+	void work(std::size_t self, std::uint32_t seen);
+	void participate(std::size_t self);
+
+	std::vector<std::thread> workers;     ///< The worker threads.
+	std::size_t participants{1};          ///< The number of worker threads plus the calling thread.
+	Queue queues[max_participants];       ///< The task queues of all participating threads.
+	std::atomic<std::uint32_t> epoch{};   ///< Incremented whenever a new block is started.
+	std::atomic<std::size_t> remaining{}; ///< The number of tasks that have not finished yet.
+	std::atomic<bool> quit{};             ///< Set when the worker threads should exit.
+
+	// The current block, only valid while there are remaining tasks
+	Module *const *modules{}; ///< The modules referred to by the tasks.
+	const Task *tasks{};      ///< The tasks to run.
+	std::size_t frames{};     ///< The number of frames to process.
+	float dt{};               ///< The time step of the calling thread.
+};
+
+void set_realtime_priority();
+
+/**
+ * Flush denormal numbers to zero on the calling thread while this object exists.
+ *
+ * Calculations that decay towards zero, like filters and envelopes, will
+ * eventually produce denormal numbers, which are very slow to process on many
+ * CPUs. This should be used by every thread that runs modules.
+ */
+struct DenormalGuard {
+	DenormalGuard();
+	DenormalGuard(const DenormalGuard &other) = delete;
+	~DenormalGuard();
+
+private:
+	std::uintptr_t saved{}; ///< The previous floating point control register.
+};
+
+}
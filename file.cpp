@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "file.hpp"
+
+#include <stdexcept>
+
+namespace ModSynth
+{
+
+namespace
+{
+
+/**
+ * Write an integer in little-endian byte order.
+ *
+ * @param file   The file to write to.
+ * @param value  The value to write.
+ * @param size   The number of bytes to write.
+ */
+void write_le(std::ofstream &file, std::uint32_t value, std::size_t size)
+{
+	for (std::size_t i = 0; i < size; i++) {
+		file.put(char(value >> (8 * i)));
+	}
+}
+
+}
+
+RawWriter::RawWriter(const std::string &filename): file(filename, std::ios::binary)
+{
+	if (!file) {
+		throw std::runtime_error("could not open " + filename);
+	}
+}
+
+void RawWriter::write(const float *samples, std::size_t frames)
+{
+	if (!file.write(reinterpret_cast<const char *>(samples), 2 * frames * sizeof *samples)) {
+		throw std::runtime_error("could not write samples");
+	}
+}
+
+WAVWriter::WAVWriter(const std::string &filename): RawWriter(filename)
+{
+	write_header();
+}
+
+WAVWriter::~WAVWriter()
+{
+	// Fill in the final sizes
+	file.seekp(0);
+	write_header();
+}
+
+void WAVWriter::write(const float *samples, std::size_t frames)
+{
+	RawWriter::write(samples, frames);
+	this->frames += frames;
+}
+
+/**
+ * Write the header of the WAV file.
+ *
+ * The header describes 32-bit floating point stereo samples, and contains the
+ * sizes corresponding to the number of frames written so far.
+ */
+void WAVWriter::write_header()
+{
+	const std::uint32_t channels = 2;
+	const std::uint32_t rate = 1 / Module::dt + 0.5f;
+	const std::uint32_t frame_size = channels * sizeof(float);
+	const std::uint32_t data_size = frames * frame_size;
+
+	file.write("RIFF", 4);
+	write_le(file, 4 + (8 + 18) + (8 + 4) + (8 + data_size), 4);
+	file.write("WAVE", 4);
+
+	file.write("fmt ", 4);
+	write_le(file, 18, 4);
+	write_le(file, 3, 2); // WAVE_FORMAT_IEEE_FLOAT
+	write_le(file, channels, 2);
+	write_le(file, rate, 4);
+	write_le(file, rate * frame_size, 4);
+	write_le(file, frame_size, 2);
+	write_le(file, 8 * sizeof(float), 2);
+	write_le(file, 0, 2);
+
+	file.write("fact", 4);
+	write_le(file, 4, 4);
+	write_le(file, frames, 4);
+
+	file.write("data", 4);
+	write_le(file, data_size, 4);
+}
+
+}
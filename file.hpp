@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "modsynth.hpp"
+
+namespace ModSynth
+{
+
+/**
+ * @brief A sink that writes raw samples to a file.
+ *
+ * The samples are written as interleaved stereo 32-bit floating point values
+ * in the native byte order, without any header.
+ */
+struct RawWriter: Sink {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param filename  The name of the file to write to.
+	 */
+	RawWriter(const std::string &filename);
+
+	void write(const float *samples, std::size_t frames) override;
+
+protected:
+	std::ofstream file; ///< The file being written to.
+};
+
+/**
+ * @brief A sink that writes a WAV file.
+ *
+ * The samples are written as interleaved stereo 32-bit floating point values.
+ * The header is updated with the final length of the audio when the writer is
+ * destroyed, so the file can be written while rendering without knowing the
+ * length in advance.
+ */
+struct WAVWriter: RawWriter {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param filename  The name of the file to write to.
+	 */
+	WAVWriter(const std::string &filename);
+	~WAVWriter();
+
+	void write(const float *samples, std::size_t frames) override;
+
+private:
+	void write_header();
+
+	std::uint32_t frames{}; ///< The number of frames written so far.
+};
+
+}
@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "cases.hpp"
+#include "file.hpp"
+#include "modsynth.hpp"
+#include "patch.hpp"
+
+using namespace ModSynth;
+using Cases::time_spent;
+
+/**
+ * @file golden.cpp
+ * @brief Regression checks of the built-in modules against golden renders.
+ *
+ * The cases are the patches from cases.hpp that bench.cpp benchmarks, a
+ * module removed while running, and any patch files given on the command
+ * line. Each is rendered offline without gain or limiter, using only the
+ * calling thread, so the output is deterministic. In record mode, the output
+ * of each case is written to a WAV file in the golden directory. In
+ * check mode, it is compared with that file, either bit for bit, or allowing
+ * a maximum error given in dB relative to full scale. The result of each case
+ * is written to the standard output as CSV, together with the time spent per
+ * sample in nanoseconds, in the measured module only if there is one, or in
+ * the whole patch otherwise.
+ */
+
+namespace
+{
+
+/// A sink that keeps the rendered audio in memory.
+struct Capture: Sink {
+	std::vector<float> samples; ///< The interleaved stereo samples.
+	std::function<void()> halfway; ///< Called on the audio thread once half of the audio has been rendered.
+	std::size_t half{};            ///< The number of frames in half of the audio.
+
+	void write(const float *samples, std::size_t frames) override
+	{
+		this->samples.insert(this->samples.end(), samples, samples + 2 * frames);
+
+		if (halfway && this->samples.size() >= 2 * half) {
+			halfway();
+			halfway = nullptr;
+		}
+	}
+};
+
+bool recording;        ///< Whether to write golden files instead of comparing with them.
+std::string directory; ///< The directory containing the golden files.
+float seconds = 1;     ///< The amount of audio rendered by each case.
+float tolerance = -std::numeric_limits<float>::infinity(); ///< The maximum error in dB, or minus infinity to require bit-exact output.
+int failures;          ///< The number of cases that did not match their golden file.
+
+/**
+ * Read the samples of a WAV file written by WAVWriter.
+ *
+ * @param filename  The name of the file.
+ * @return          The interleaved stereo samples.
+ */
+std::vector<float> read_wav(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	char id[4];
+	std::uint32_t size;
+
+	if (!file.read(id, 4) || std::memcmp(id, "RIFF", 4) || !file.ignore(8)) {
+		throw std::runtime_error("could not read " + filename);
+	}
+
+	// Skip all chunks up to the samples
+	while (file.read(id, 4) && file.read(reinterpret_cast<char *>(&size), 4)) {
+		if (std::memcmp(id, "data", 4) == 0) {
+			std::vector<float> samples(size / sizeof(float));
+			file.read(reinterpret_cast<char *>(samples.data()), samples.size() * sizeof(float));
+
+			if (!file) {
+				break;
+			}
+
+			return samples;
+		}
+
+		file.ignore(size);
+	}
+
+	throw std::runtime_error("could not read the samples of " + filename);
+}
+
+/**
+ * Get the largest difference between two renders.
+ *
+ * @param a  The samples of one render.
+ * @param b  The samples of the other render, of the same length.
+ * @return   The largest difference in dB relative to full scale, or minus infinity if there is none.
+ */
+float max_error(const std::vector<float> &a, const std::vector<float> &b)
+{
+	float error = 0;
+
+	for (std::size_t i = 0; i < a.size(); i++) {
+		float difference = std::abs(a[i] - b[i]);
+
+		// A NaN where the other render has none is as wrong as it gets
+		if (std::isnan(a[i]) && std::isnan(b[i])) {
+			continue;
+		} else if (!(difference <= error)) {
+			error = std::isnan(difference) ? std::numeric_limits<float>::infinity() : difference;
+		}
+	}
+
+	return 20 * std::log10(error);
+}
+
+/**
+ * Render the currently existing modules, and record or check the output.
+ *
+ * @param name     The name of the case, which is also the name of its golden file.
+ * @param mod      The module to measure the time of, or nullptr to measure the whole patch.
+ * @param halfway  A function to call on the audio thread halfway through, while the audio output is running.
+ */
+void verify(const std::string &name, const Module *mod = nullptr, std::function<void()> halfway = nullptr)
+{
+	Capture capture;
+	capture.halfway = std::move(halfway);
+	Settings settings;
+	capture.half = std::lround(seconds * settings.sample_rate / 2);
+	settings.gain = 1;
+	settings.limit = std::numeric_limits<float>::infinity();
+
+	set_profiling(mod != nullptr);
+	auto before = mod ? time_spent(*mod) : 0;
+	auto start = std::chrono::steady_clock::now();
+	render(seconds, capture, settings);
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	auto frames = capture.samples.size() / 2;
+	auto ns = (mod ? time_spent(*mod) - before : elapsed.count()) / frames;
+	set_profiling(false);
+
+	auto filename = directory + "/" + name + ".wav";
+	std::string result;
+	float error = 0;
+
+	if (recording) {
+		WAVWriter writer{filename};
+		writer.write(capture.samples.data(), frames);
+		result = "recorded";
+	} else {
+		try {
+			auto golden = read_wav(filename);
+
+			if (golden.size() != capture.samples.size()) {
+				result = "wrong_length";
+			} else {
+				bool exact = std::memcmp(golden.data(), capture.samples.data(), golden.size() * sizeof(float)) == 0;
+				error = max_error(golden, capture.samples);
+				result = exact ? "exact" : error <= tolerance ? "within_tolerance" : "FAIL";
+			}
+		} catch (std::runtime_error &) {
+			result = "missing";
+		}
+
+		failures += result != "exact" && result != "within_tolerance";
+	}
+
+	std::cout << name << ',' << result << ',' << error << ',' << ns << std::endl;
+}
+
+/**
+ * Check a case shared with the benchmarks.
+ *
+ * The name of the golden file is the name of the case in snake case,
+ * followed by the variant.
+ */
+void check(const std::string &benchmark, const std::string &variant, const Module *mod)
+{
+	std::string name;
+
+	for (std::size_t i = 0; i < benchmark.size(); i++) {
+		if (i && std::isupper(benchmark[i]) && std::islower(benchmark[i - 1])) {
+			name += '_';
+		}
+
+		name += std::tolower(benchmark[i]);
+	}
+
+	verify(name + "_" + variant, mod);
+}
+
+/**
+ * Check removing a multi-tap delay while it is running.
+ *
+ * The ports of a multi-tap delay are not stored inside the module itself, but
+ * they must be disconnected all the same. After the removal, the speaker reads
+ * silence.
+ */
+void check_delay_removed()
+{
+	VCO vco{440};
+	VCO lfo{2};
+	Speaker speaker;
+	auto arena = std::make_unique<Arena>();
+	auto &taps = arena->make<MultiTapDelay>(4);
+	taps.in.connect(vco.sine_out);
+	taps.delay[0].connect(lfo.triangle_out);
+	taps.delay[1] = 0.2f;
+	speaker.left_in.connect(taps.out[0]);
+	speaker.right_in.connect(taps.out[1]);
+
+	verify("multi_tap_delay_removed", nullptr, [&arena] {
+		arena.reset();
+	});
+}
+
+/**
+ * Check a patch file.
+ *
+ * @param filename  The name of the patch file, the name of the case is based on it.
+ */
+void check_patch(const std::string &filename)
+{
+	Patch patch{load_patch(filename)};
+	verify("patch_" + std::filesystem::path(filename).stem().string());
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> patches;
+
+	for (int i = 3; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg.starts_with("--tolerance=")) {
+			tolerance = std::atof(arg.c_str() + 12);
+		} else if (arg.starts_with("--seconds=")) {
+			seconds = std::atof(arg.c_str() + 10);
+		} else {
+			patches.push_back(arg);
+		}
+	}
+
+	if (argc < 3 || (argv[1] != std::string("record") && argv[1] != std::string("check")) || seconds <= 0) {
+		std::cerr << "Usage: " << argv[0] << " record|check directory [--tolerance=dB] [--seconds=seconds] [patch...]\n";
+		return 1;
+	}
+
+	recording = argv[1] == std::string("record");
+	directory = argv[2];
+
+	if (recording) {
+		std::filesystem::create_directories(directory);
+	}
+
+	std::cout << "case,result,max_error_db,ns_per_sample\n";
+
+	Cases::modules(check);
+	check_delay_removed();
+	Cases::voices(check, 8);
+	Cases::example(check, false);
+	Cases::example(check, true);
+
+	for (auto &filename : patches) {
+		check_patch(filename);
+	}
+
+	return failures != 0;
+}
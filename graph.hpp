@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+
+#include "modsynth.hpp"
+#include "registry.hpp"
+
+/**
+ * @file graph.hpp
+ * @brief Patches whose modules are fixed at compile time.
+ *
+ * Normally, the audio thread runs every module through a virtual call to
+ * process(), in an order that is only known at run time, so the compiler
+ * cannot optimize across modules. A StaticGraph runs a fixed list of modules
+ * itself, in an order that is known at compile time, using direct calls to
+ * the process() function of each module's actual type. The modules are
+ * implemented in modsynth.cpp, so the build enables link-time optimization to
+ * let these calls be inlined into a single function.
+ */
+
+namespace ModSynth
+{
+
+/**
+ * @brief A fixed list of modules that are run as one.
+ *
+ * The modules are constructed and connected as usual, but are then run by the
+ * graph instead of by the audio thread, in the order they are passed to the
+ * constructor, which must be the order of the connections between them. The
+ * constructor checks this against the connections made so far, so connect the
+ * modules first. A module that reads from a module after it in a connection
+ * made later would silently get its input one block late. The types of the
+ * modules are deduced from the constructor arguments:
+ *
+ *     StaticGraph graph{clock, sequencer, vco, envelope, vca, speaker};
+ *
+ * All modules must implement process(). The graph as a whole is profiled as
+ * a single module.
+ */
+template<typename... Modules>
+struct StaticGraph: Module {
+	static_assert((std::is_base_of_v<Module, Modules> && ...), "all modules must derive from Module");
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param modules  The modules to run, in the order they must be run.
+	 * @throw std::invalid_argument if a module reads from a module that comes after it.
+	 */
+	StaticGraph(Modules &...modules): modules(modules...)
+	{
+		Registry::get().check_order({&modules...});
+		(add(modules), ...);
+	}
+
+	void process(std::size_t frames) override
+	{
+		std::apply([frames](auto &...mod) {
+			(run(mod, frames), ...);
+		}, modules);
+	}
+
+	bool block_processing() const override { return true; }
+
+private:
+	/// Take over running a module.
+	void add(Module &mod)
+	{
+		if (!mod.block_processing()) {
+			throw std::invalid_argument("modules of a static graph must implement process()");
+		}
+
+		contain(mod);
+	}
+
+	/// Run a module, unless it is sleeping.
+	template<typename T>
+	static void run(T &mod, std::size_t frames)
+	{
+		if (!mod.asleep()) {
+			// A qualified call is not virtual, so it can be inlined
+			mod.T::process(frames);
+		}
+	}
+
+	std::tuple<Modules &...> modules; ///< The modules, in the order they are run.
+};
+
+}
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "audio.hpp"
+#include "profile.hpp"
+
+#include <jack/jack.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ModSynth
+{
+
+namespace
+{
+
+/**
+ * Audio output using JACK.
+ *
+ * This registers one output port per channel, and generates audio from JACK's
+ * process callback. The sample rate and period size are those of the JACK
+ * server. This also works with PipeWire's JACK compatibility layer.
+ */
+struct JACKDevice: Device {
+	jack_client_t *client{};           ///< The JACK client handle.
+	std::vector<jack_port_t *> ports;  ///< The output port of each channel.
+	std::vector<float *> outputs;      ///< Pointers to the buffer of each port.
+
+	/**
+	 * The constructor.
+	 *
+	 * @param settings  The settings to open the device with. The device is the name of the JACK client.
+	 */
+	JACKDevice(Settings &settings): ports(settings.channels), outputs(settings.channels)
+	{
+		auto name = settings.device.empty() ? "modsynth" : settings.device.c_str();
+		client = jack_client_open(name, JackNoStartServer, nullptr);
+
+		if (!client) {
+			throw std::runtime_error("could not connect to the JACK server");
+		}
+
+		for (size_t c = 0; c < ports.size(); c++) {
+			auto port_name = "out_" + std::to_string(c + 1);
+			ports[c] = jack_port_register(client, port_name.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+
+			if (!ports[c]) {
+				jack_client_close(client);
+				throw std::runtime_error("could not register JACK port " + port_name);
+			}
+		}
+
+		jack_set_process_callback(client, callback, this);
+		jack_set_xrun_callback(client, xrun, nullptr);
+
+		settings.sample_rate = jack_get_sample_rate(client);
+		settings.period = jack_get_buffer_size(client);
+	}
+
+	~JACKDevice()
+	{
+		jack_client_close(client);
+	}
+
+	void start() override
+	{
+		if (jack_activate(client)) {
+			throw std::runtime_error("could not activate the JACK client");
+		}
+
+		// Connect to the physical playback ports, if there are any
+		auto playback = jack_get_ports(client, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsPhysical | JackPortIsInput);
+
+		if (!playback) {
+			return;
+		}
+
+		for (size_t c = 0; c < ports.size() && playback[c]; c++) {
+			jack_connect(client, jack_port_name(ports[c]), playback[c]);
+		}
+
+		jack_free(playback);
+	}
+
+	void stop() override
+	{
+		jack_deactivate(client);
+	}
+
+	/**
+	 * The JACK process callback.
+	 *
+	 * @param nframes   The number of frames to generate.
+	 * @param userdata  A pointer to the device object.
+	 * @return          Always zero.
+	 */
+	static int callback(jack_nframes_t nframes, void *userdata)
+	{
+		auto self = static_cast<JACKDevice *>(userdata);
+
+		for (size_t c = 0; c < self->ports.size(); c++) {
+			self->outputs[c] = static_cast<float *>(jack_port_get_buffer(self->ports[c], nframes));
+		}
+
+		generate(self->outputs.data(), self->outputs.size(), 1, nframes);
+		return 0;
+	}
+
+	/**
+	 * The JACK xrun callback.
+	 *
+	 * @return  Always zero.
+	 */
+	static int xrun(void *)
+	{
+		Profiler::xrun();
+		return 0;
+	}
+};
+
+}
+
+std::unique_ptr<Device> open_jack(Settings &settings)
+{
+	return std::make_unique<JACKDevice>(settings);
+}
+
+}
@@ -2,47 +2,107 @@
 
 #include "midi.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
-#include <iostream>
+#include <stdexcept>
 
 namespace ModSynth
 {
 
-MIDI::MIDI(const std::string &name)
+int NoteSet::highest() const
 {
-	snd_seq_open(&seq, "default", SND_SEQ_OPEN_INPUT, 0);
+	if (bits[1]) {
+		return 127 - std::countl_zero(bits[1]);
+	} else if (bits[0]) {
+		return 63 - std::countl_zero(bits[0]);
+	} else {
+		return -1;
+	}
+}
+
+MIDI::MIDI(const std::string &name, size_t voices, Stealing stealing): stealing(stealing)
+{
+	if (voices > 127) {
+		throw std::invalid_argument("too many voices");
+	}
+
+	for (auto &ch : channels) {
+		ch.voices = std::vector<Voice>(voices);
+		std::fill_n(ch.voice_of, 128, -1);
+	}
+
+	if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_INPUT, 0) < 0) {
+		throw std::runtime_error("could not open the ALSA sequencer");
+	}
+
 	snd_seq_nonblock(seq, true);
 	snd_seq_set_client_name(seq, name.c_str());
 	snd_seq_create_simple_port(seq, name.c_str(),
 	                           SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
 	                           SND_SEQ_PORT_TYPE_SOFTWARE | SND_SEQ_PORT_TYPE_SYNTHESIZER);
-	struct pollfd pfds[10];
-	auto npfd = snd_seq_poll_descriptors_count(seq, POLLIN);
-	snd_seq_poll_descriptors(seq, pfds, npfd, POLLIN);
+	pfds.resize(snd_seq_poll_descriptors_count(seq, POLLIN));
+	snd_seq_poll_descriptors(seq, pfds.data(), pfds.size(), POLLIN);
+
+	// Events are only processed up to the queue size per block, so this never has to allocate memory
+	changed.reserve(max_changes * queue_size);
+
+	thread = std::thread(&MIDI::receive, this);
 }
 
 MIDI::~MIDI()
 {
-	if (seq) {
-		snd_seq_delete_port(seq, 0);
-		snd_seq_close(seq);
-	}
+	quit = true;
+	thread.join();
+
+	snd_seq_delete_port(seq, 0);
+	snd_seq_close(seq);
 }
 
-void MIDI::update()
+void MIDI::receive()
 {
-	while (true) {
+	while (!quit) {
+		// Wake up regularly to check whether we should quit
+		if (poll(pfds.data(), pfds.size(), 100) <= 0) {
+			continue;
+		}
+
+		auto time = std::chrono::steady_clock::now();
 		snd_seq_event_t *event;
-		auto left = snd_seq_event_input(seq, &event);
 
-		if (event) {
-			process_event(event);
+		while (snd_seq_event_input(seq, &event) >= 0) {
+			if (event) {
+				events.push({*event, time});
+			}
 		}
+	}
+}
 
-		if (left <= 0) {
-			break;
-		}
+void MIDI::process(size_t frames)
+{
+	// Make the outputs changed in the previous block constant again
+	for (auto output : changed) {
+		std::fill_n(output->buffer, max_block_size, (*output)[this->frames - 1]);
 	}
+
+	changed.clear();
+	this->frames = frames;
+
+	// Events received during the last block are applied at the same offset in this block
+	auto now = std::chrono::steady_clock::now();
+	auto start = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(frames * dt));
+	Event event;
+
+	for (size_t count = 0; count < queue_size && events.pop(event); count++) {
+		auto offset = std::chrono::duration<float>(event.time - start).count() / dt;
+		process_event(&event.event, std::min(std::max(offset, 0.0f), float(frames - 1)));
+	}
+}
+
+void MIDI::set(Output &output, float value, size_t offset)
+{
+	std::fill(output.buffer + offset, output.buffer + frames, value);
+	changed.push_back(&output);
 }
 
 static float note_to_frequency(uint8_t note)
@@ -50,41 +110,123 @@ static float note_to_frequency(uint8_t note)
 	return 440.0f * std::exp2((note - 69.0f) / 12.0f);
 }
 
-static float highest_note_frequency(const std::bitset<128> &notes)
+static float highest_note_frequency(const NoteSet &notes)
+{
+	auto note = notes.highest();
+	return note < 0 ? 0.0f : note_to_frequency(note);
+}
+
+MIDI::Voice &MIDI::allocate(Channel &ch, uint8_t note)
 {
-	for (uint8_t note = 128; note--;) {
-		if (notes.test(note)) {
-			return note_to_frequency(note);
+	auto &voices = ch.voices;
+	Voice *best{};
+
+	// Reuse the voice already playing the same note
+	if (stealing == SAME_NOTE && ch.voice_of[note] >= 0) {
+		return voices[ch.voice_of[note]];
+	}
+
+	// Prefer the voice that was released the longest time ago
+	for (auto &voice : voices) {
+		if (!voice.held && (!best || voice.stamp < best->stamp)) {
+			best = &voice;
+		}
+	}
+
+	if (best) {
+		return *best;
+	}
+
+	// All voices are playing, steal one
+	for (auto &voice : voices) {
+		if (!best || (stealing == QUIETEST ? voice.level[0] < best->level[0] : voice.stamp < best->stamp)) {
+			best = &voice;
 		}
 	}
 
-	return {};
+	return *best;
 }
 
-void MIDI::process_event(const snd_seq_event_t *event)
+void MIDI::note_on(Channel &ch, uint8_t note, float velocity, size_t offset)
 {
-	std::cerr << ".";
+	if (ch.voices.empty()) {
+		return;
+	}
+
+	auto &voice = allocate(ch, note);
+	auto index = &voice - ch.voices.data();
+
+	// The same note might still be pressed on another voice
+	if (ch.voice_of[note] >= 0 && ch.voice_of[note] != index) {
+		note_off(ch, note, offset);
+	}
+
+	if (voice.note >= 0 && ch.voice_of[voice.note] == index) {
+		ch.voice_of[voice.note] = -1;
+	}
+
+	voice.note = note;
+	voice.held = true;
+	voice.stamp = ++stamp;
+	ch.voice_of[note] = index;
+
+	set(voice.frequency, note_to_frequency(note), offset);
+	set(voice.velocity, velocity, offset);
 
+	// Close the gate of a voice that is still playing for one time step, so its envelope restarts
+	if (voice.gate[offset] > 0 && offset + 1 < frames) {
+		set(voice.gate, 0, offset);
+		offset++;
+	}
+
+	set(voice.gate, 1, offset);
+}
+
+void MIDI::note_off(Channel &ch, uint8_t note, size_t offset)
+{
+	auto index = ch.voice_of[note];
+
+	if (index < 0) {
+		return;
+	}
+
+	auto &voice = ch.voices[index];
+
+	if (!voice.held) {
+		return;
+	}
+
+	voice.held = false;
+	voice.stamp = ++stamp;
+
+	set(voice.release_velocity, voice.velocity[offset], offset);
+	set(voice.gate, 0, offset);
+}
+
+void MIDI::process_event(const snd_seq_event_t *event, size_t offset)
+{
 	switch (event->type) {
 	case SND_SEQ_EVENT_NOTEON: {
 		auto &ch = channels[event->data.note.channel];
 
 		if (event->data.note.velocity) {
 			if (ch.notes.none()) {
-				ch.velocity = event->data.note.velocity / 127.0f;
+				set(ch.velocity, event->data.note.velocity / 127.0f, offset);
 			}
 
 			ch.notes.set(event->data.note.note);
-			ch.frequency = highest_note_frequency(ch.notes);
-			ch.gate = 1;
+			set(ch.frequency, highest_note_frequency(ch.notes), offset);
+			set(ch.gate, 1, offset);
+			note_on(ch, event->data.note.note, event->data.note.velocity / 127.0f, offset);
 		} else {
 			ch.notes.reset(event->data.note.note);
+			note_off(ch, event->data.note.note, offset);
 
 			if (ch.notes.none()) {
-				ch.release_velocity = ch.velocity;
-				ch.gate = 0;
+				set(ch.release_velocity, ch.velocity[offset], offset);
+				set(ch.gate, 0, offset);
 			} else {
-				ch.frequency = highest_note_frequency(ch.notes);
+				set(ch.frequency, highest_note_frequency(ch.notes), offset);
 			}
 		}
 
@@ -95,12 +237,13 @@ void MIDI::process_event(const snd_seq_event_t *event)
 		auto &ch = channels[event->data.note.channel];
 
 		ch.notes.reset(event->data.note.note);
+		note_off(ch, event->data.note.note, offset);
 
 		if (ch.notes.none()) {
-			ch.release_velocity = ch.velocity;
-			ch.gate = 0;
+			set(ch.release_velocity, ch.velocity[offset], offset);
+			set(ch.gate, 0, offset);
 		} else {
-			ch.frequency = highest_note_frequency(ch.notes);
+			set(ch.frequency, highest_note_frequency(ch.notes), offset);
 		}
 
 		break;
@@ -110,8 +253,8 @@ void MIDI::process_event(const snd_seq_event_t *event)
 		auto &ch = channels[event->data.note.channel];
 		auto frequency = event->data.note.note;
 
-		if (ch.frequency == frequency) {
-			ch.aftertouch = event->data.note.velocity / 127.0f;
+		if (ch.frequency[offset] == frequency) {
+			set(ch.aftertouch, event->data.note.velocity / 127.0f, offset);
 		}
 
 		break;
@@ -119,19 +262,19 @@ void MIDI::process_event(const snd_seq_event_t *event)
 
 	case SND_SEQ_EVENT_CHANPRESS: {
 		auto &ch = channels[event->data.control.channel];
-		ch.aftertouch = event->data.control.value / 127.0f;
+		set(ch.aftertouch, event->data.control.value / 127.0f, offset);
 		break;
 	}
 
 	case SND_SEQ_EVENT_PITCHBEND: {
 		auto &ch = channels[event->data.control.channel];
-		ch.pitch_bend = event->data.control.value / 4096.0f;
+		set(ch.pitch_bend, event->data.control.value / 4096.0f, offset);
 		break;
 	}
 
 	case SND_SEQ_EVENT_CONTROLLER: {
 		auto &ch = channels[event->data.control.channel];
-		ch.parameter[event->data.control.param] = event->data.control.value / 127.0f;
+		set(ch.parameter[event->data.control.param], event->data.control.value / 127.0f, offset);
 		break;
 	}
 
@@ -3,14 +3,35 @@
 #pragma once
 
 #include <alsa/asoundlib.h>
-#include <bitset>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "modsynth.hpp"
+#include "queue.hpp"
 
 namespace ModSynth
 {
 
+/**
+ * @brief A set of MIDI notes.
+ *
+ * This keeps track of which notes are pressed, and finds the highest pressed
+ * note in constant time.
+ */
+struct NoteSet {
+	void set(std::uint8_t note) { bits[note >> 6] |= std::uint64_t(1) << (note & 63); }     ///< Add a note.
+	void reset(std::uint8_t note) { bits[note >> 6] &= ~(std::uint64_t(1) << (note & 63)); } ///< Remove a note.
+	bool none() const { return !(bits[0] | bits[1]); }                                       ///< Check whether the set is empty.
+	int highest() const;                                                                     ///< Get the highest note, or -1 if the set is empty.
+
+private:
+	std::uint64_t bits[2]{}; ///< One bit per note.
+};
+
 /**
  * @brief A MIDI input module.
  *
@@ -18,35 +39,116 @@ namespace ModSynth
  * The supported events are:
  *
  * - note on/off: will be converted to frequency and gate outputs, one pair per channel.
+ *   If voices are enabled, notes are also assigned to the voices of each channel.
  * - control changes: will be converted to values
  * - pitch bend, aftertouch: will be converted to values
+ *
+ * The per-channel frequency and gate outputs are monophonic, and follow the
+ * highest pressed note. For polyphony, the MIDI module can be constructed with
+ * a number of voices per channel. Each new note is then assigned to a voice
+ * that is not playing, preferring the one that was released the longest time
+ * ago. If all voices are playing, a voice is stolen according to the #Stealing
+ * policy. A stolen voice has its gate closed for one time step, so its
+ * envelope starts a new attack. Together with sleep_while_idle(), the modules
+ * of voices that are not playing cost no CPU time.
+ *
+ * Connecting Voice::level to the envelope of a voice creates a feedback loop,
+ * so the MIDI module should be constructed before the voices, to ensure the
+ * level is delayed by one block instead of the gate.
+ *
+ * Events are received by a separate thread, which timestamps them and passes
+ * them on to the audio thread via a lock-free queue. The audio thread applies
+ * them at the time step corresponding to their arrival time, so the outputs
+ * are delayed by one block, but the timing between events is preserved.
  */
 struct MIDI: Module {
+	/// The way a voice is chosen when a note is played while all voices are playing.
+	enum Stealing {
+		OLDEST,    ///< Steal the voice that has been playing the longest.
+		QUIETEST,  ///< Steal the voice with the lowest Voice::level.
+		SAME_NOTE, ///< Reuse a voice that plays the same note, even if one is free, otherwise steal the oldest.
+	};
+
 	/// @name Outputs
 	///@{
+	/// A single voice of a channel.
+	struct Voice {
+		Input level;             ///< The current level of the voice, used by the #QUIETEST policy, typically the output of its envelope.
+		Output frequency;        ///< The frequency of the note assigned to this voice
+		Output velocity;         ///< The velocity of the note assigned to this voice
+		Output release_velocity; ///< The release velocity of the note assigned to this voice
+		Output gate;             ///< Gate output, > 0 while the note is pressed, <= 0 when released
+	private:
+		friend struct MIDI;
+		int note{-1};           ///< The note assigned to this voice, or -1 if none.
+		bool held{};            ///< Whether the note is still pressed.
+		std::uint64_t stamp{};  ///< When the note was pressed or released.
+	};
+
 	struct Channel {
-		float frequency;        ///< The frequency of the last pressed note
-		float velocity;         ///< The velocity of the last pressed note
-		float release_velocity; ///< The release velocity of the last pressed note
-		float gate;             ///< Gate output, > 0 if the note is pressed, <= 0 if the note is released
-		float aftertouch;       ///< The amount of aftertouch, between 0 and 1
-		float pitch_bend;       ///< The amount of pitch bend, between -1 and 1
-		float parameter[128];   ///< Holds the value for each MIDI parameter, between 0 and 1
+		Output frequency;        ///< The frequency of the last pressed note
+		Output velocity;         ///< The velocity of the last pressed note
+		Output release_velocity; ///< The release velocity of the last pressed note
+		Output gate;             ///< Gate output, > 0 if the note is pressed, <= 0 if the note is released
+		Output aftertouch;       ///< The amount of aftertouch, between 0 and 1
+		Output pitch_bend;       ///< The amount of pitch bend, between -1 and 1
+		Output parameter[128];   ///< Holds the value for each MIDI parameter, between 0 and 1
+		std::vector<Voice> voices; ///< The voices the notes of this channel are assigned to
 	private:
 		friend struct MIDI;
-		std::bitset<128> notes;
+		NoteSet notes;
+		std::int8_t voice_of[128]; ///< The voice each note is assigned to, or -1 if none.
 	} channels[16]; ///< The state of all the channels of this MIDI port
 	///@}
 
-	MIDI(const std::string &name = "modsynth");
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param name      The name of the MIDI port.
+	 * @param voices    The number of voices per channel, at most 127.
+	 * @param stealing  The way voices are stolen if all of them are playing.
+	 */
+	MIDI(const std::string &name = "modsynth", std::size_t voices = 0, Stealing stealing = OLDEST);
 	~MIDI();
 
-	void update(); ///< The function that will update the state of this module.
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
 
 private:
-	void process_event(const snd_seq_event_t *event); ///< Process a single MIDI event
+	/// A MIDI event and the time it was received.
+	struct Event {
+		snd_seq_event_t event;                      ///< The ALSA sequencer event.
+		std::chrono::steady_clock::time_point time; ///< The time the event was received.
+	};
+
+	static constexpr std::size_t queue_size = 1024; ///< The maximum number of events received per block.
+
+	/**
+	 * The maximum number of times a single event calls set().
+	 *
+	 * A note on changes the velocity, frequency and gate of its channel, and
+	 * note_on() changes the frequency, velocity and twice the gate of a voice,
+	 * after note_off() changed the release velocity and gate of another voice
+	 * still playing the same note.
+	 */
+	static constexpr std::size_t max_changes = 3 + 4 + 2;
+
+	void receive();                                                        ///< The main loop of the MIDI thread.
+	void process_event(const snd_seq_event_t *event, std::size_t offset); ///< Process a single MIDI event
+	void set(Output &output, float value, std::size_t offset);            ///< Change an output from a given time step on.
+	void note_on(Channel &ch, std::uint8_t note, float velocity, std::size_t offset); ///< Assign a note to a voice.
+	void note_off(Channel &ch, std::uint8_t note, std::size_t offset);                ///< Release the voice playing a note.
+	Voice &allocate(Channel &ch, std::uint8_t note);                                   ///< Choose the voice to play a note.
 
-	snd_seq_t *seq{}; ///< The ALSA sequencer handle
+	snd_seq_t *seq{};                    ///< The ALSA sequencer handle
+	std::vector<pollfd> pfds;            ///< The file descriptors of the sequencer to poll
+	SPSCQueue<Event, queue_size> events; ///< Events passed from the MIDI thread to the audio thread
+	std::vector<Output *> changed;       ///< Outputs whose buffers are not constant
+	Stealing stealing;                   ///< The voice stealing policy
+	std::uint64_t stamp{};               ///< Incremented for every note pressed or released
+	std::size_t frames{};                ///< The number of frames in the current block
+	std::atomic<bool> quit{};            ///< Set when the MIDI thread should exit
+	std::thread thread;                  ///< The MIDI thread
 };
 
 }
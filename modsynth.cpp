@@ -1,17 +1,38 @@
 /* SPDX-License-Identifier: MIT */
 
 #include "modsynth.hpp"
+#include "audio.hpp"
+#include "dsp.hpp"
+#include "profile.hpp"
+#include "registry.hpp"
+#include "tap.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
 #include <map>
+#include <memory>
+#include <queue>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
 #include <iostream>
 
 #include <SDL2/SDL.h>
 
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
 /**
  * @mainpage ModSynth - a modular synthesizer framework for C++
  *
@@ -23,12 +44,16 @@
  * inputs and outputs of the component it implements, and these inputs and
  * outputs can be connected together in two possible ways:
  *
- * 1. By declaring Wire objects that will automatically copy from a given output to a given input.
+ * 1. By calling Input::connect() or declaring Wire objects, which will make the input read directly from a given output.
  * 2. By defining a new Module type, and adding assignment statements in a user-defined update() function.
  *
  * It is also easy to create new module types yourself. Finally, this library
  * will take care of sending the output sent to Speaker objects  to the sound card.
  *
+ * For polyphonic synthesizers, bank.hpp provides banks like VCOBank and VCFBank,
+ * which implement N voices of a module in a single object, and update all
+ * voices at once using SIMD instructions.
+ *
  * [modular synthesizer]: https://en.wikipedia.org/wiki/Modular_synthesizer
  * [VCO]: https://en.wikipedia.org/wiki/Voltage-controlled_oscillator
  * [envelope generator]: https://en.wikipedia.org/wiki/Envelope_(music)
@@ -41,285 +66,1621 @@ namespace ModSynth
 namespace
 {
 
+/// The time step of the audio output, as opposed to the thread-local Module::dt.
+float sample_dt = 1.0f / 48000.0f;
+
+/// The number of time steps generated so far, the start of the block being generated.
+std::atomic<std::uint64_t> generated{};
+
 /**
- * The module registry.
+ * Audio output handling.
+ *
+ * This holds the output bus the Speaker objects add their output to, and the
+ * audio output device, which is only opened when the audio output is started.
  *
- * This is a singleton class that provides access to the vector of modules. We
- * use this instead of a regular static variable since we can't guarantee that
- * the vector modules will be initialized before any objects that are derived
- * from Module.
+ * Every thread running modules has its own partial mix of all the channels,
+ * so speakers can run in parallel without any synchronization. The partial
+ * mixes are summed once per block, after which the master gain and limiter
+ * are applied.
  */
-struct Registry {
-	std::vector<Module *> modules; ///< The list of registered modules.
+struct Audio {
+	std::size_t channels{};      ///< The number of channels of the bus.
+	std::size_t participants{};  ///< The number of threads that have a partial mix.
+	std::vector<float> bus;      ///< The partial mixes, one block per channel per thread.
+	float gain{};                ///< The master gain.
+	float limit{};               ///< The level the output is limited to.
+	float release{};             ///< The factor the gain reduction of the limiter decays with every time step.
+	float reduction{1};          ///< The current gain reduction of the limiter.
+
+	std::unique_ptr<Device> device; ///< The opened audio output device, if any.
 
 	/**
-	 * Get a reference to the global module registry instance.
+	 * The destructor.
 	 *
-	 * @return A reference to the module registry.
+	 * This will close the audio output device, if it is still open.
 	 */
-	static Registry &get();
-};
+	~Audio()
+	{
+		stop();
+	}
 
-Registry &Registry::get()
-{
-	static Registry the_registry;
-	return the_registry;
-}
+	/**
+	 * Allocate the bus and set up the master section.
+	 *
+	 * This must be called while no audio is being generated, after the worker
+	 * threads have been started and the sample rate has been set.
+	 *
+	 * @param settings  The settings containing the master gain and limit.
+	 * @param channels  The number of channels of the output.
+	 */
+	void configure(const Settings &settings, std::size_t channels)
+	{
+		// Mono output is a mix of the first two channels
+		this->channels = std::max<std::size_t>(channels, 2);
+		participants = Registry::get().executor.threads() + 1;
+		bus.assign(participants * this->channels * Module::max_block_size, 0.0f);
+		gain = settings.gain;
+		limit = settings.limit;
+		release = std::exp2(-sample_dt / 0.05f);
+		reduction = 1;
+	}
 
-/**
- * Audio output handling.
- *
- * This class opens the audio card using SDL and registers a callback for providing audio data to SDL.
- * The callback in turn calls the update() function of all the registered Module objects.
- */
-struct Audio {
-	static float left;  ///< The left channel sample accumulator.
-	static float right; ///< The right channel sample accumulator.
+	/**
+	 * Add a signal to a channel of the partial mix of the calling thread.
+	 *
+	 * @param in       The signal to add.
+	 * @param channel  The channel to add it to, ignored if the bus does not have that channel.
+	 * @param frames   The number of time steps to add.
+	 */
+	void add(const Input &in, std::size_t channel, std::size_t frames)
+	{
+		if (channel >= channels) {
+			return;
+		}
+
+		float *mix = bus.data() + (Executor::participant * channels + channel) * Module::max_block_size;
+
+		for (size_t i = 0; i < frames; i++) {
+			mix[i] += in[i];
+		}
+	}
 
 	/**
-	 * The SDL audio callback.
+	 * Mix the bus down to the output.
 	 *
-	 * This function is called by SDL whenever a new chunk of samples needs to be sent to the audio card.
+	 * This sums the partial mixes of all threads, applies the master gain and
+	 * limiter, and clears the bus for the next block.
 	 *
-	 * @param userdata[in]  A pointer to the registry object.
-	 * @param stream[out]   A pointer to the buffer where the audio samples must be written.
-	 * @param len           The length of the buffer in bytes, for one channel only.
+	 * @param outputs       Pointers to the first sample of each output channel.
+	 * @param out_channels  The number of output channels.
+	 * @param stride        The distance between two samples of the same channel.
+	 * @param offset        The index of the first frame to write.
+	 * @param frames        The number of frames to write.
 	 */
-	static void callback(void *userdata, uint8_t *stream, int len)
+	void mix(float *const *outputs, std::size_t out_channels, std::size_t stride, std::size_t offset, std::size_t frames)
 	{
-		auto registry = static_cast<Registry *>(userdata);
-		float *ptr = reinterpret_cast<float *>(stream);
+		const size_t block = Module::max_block_size;
+
+		for (size_t p = 1; p < participants; p++) {
+			for (size_t c = 0; c < channels; c++) {
+				const float *partial = bus.data() + (p * channels + c) * block;
+				float *sum = bus.data() + c * block;
+
+				for (size_t i = 0; i < frames; i++) {
+					sum[i] += partial[i];
+				}
+			}
+		}
+
+		// Reduce peaks above the limit instantly, and let the gain recover slowly
+		float gains[block];
+
+		for (size_t i = 0; i < frames; i++) {
+			float peak = 0;
+
+			for (size_t c = 0; c < channels; c++) {
+				peak = std::max(peak, std::abs(bus[c * block + i]) * gain);
+			}
 
-		for (size_t i = 0; i < len / sizeof ptr; i++) {
-			left = 0;
-			right = 0;
+			float target = peak > limit ? limit / peak : 1.0f;
+			reduction = target < reduction ? target : target + (reduction - target) * release;
+			gains[i] = gain * reduction;
+		}
+
+		for (size_t c = 0; c < out_channels; c++) {
+			float *ptr = outputs[c] + offset * stride;
 
-			for (auto mod : registry->modules) {
-				mod->update();
+			for (size_t i = 0; i < frames; i++) {
+				float sample = out_channels == 1 ? (bus[i] + bus[block + i]) * 0.5f : bus[c * block + i];
+				ptr[i * stride] = sample * gains[i];
 			}
+		}
 
-			// Make the output a bit softer so we don't immediately clip
-			*ptr++ = left * 0.1;
-			*ptr++ = right * 0.1;
+		for (size_t b = 0; b < participants * channels; b++) {
+			std::fill_n(bus.data() + b * block, frames, 0.0f);
 		}
 	}
+} audio;
+
+/**
+ * Audio output using SDL.
+ *
+ * This opens the audio card using SDL and registers a callback for providing audio data to SDL.
+ */
+struct SDLDevice: Device {
+	std::size_t channels;         ///< The number of channels.
+	std::vector<float *> outputs; ///< Pointers to the first sample of each channel.
+	SDL_AudioDeviceID device;     ///< The opened audio device.
 
 	/**
 	 * The constructor.
 	 *
 	 * This will intialize the SDL audio subsystem and register the audio callback function.
+	 *
+	 * @param settings  The settings to open the audio card with, which are updated with the actual sample rate and period size.
+	 * @param driver    The name of the SDL audio driver to use, or nullptr to use the default driver.
 	 */
-	Audio()
+	SDLDevice(Settings &settings, const char *driver): channels(settings.channels), outputs(channels)
 	{
-		SDL_Init(SDL_INIT_AUDIO);
+		// The driver has to be chosen before the subsystem is initialized, a null hint restores the default
+		SDL_SetHint(SDL_HINT_AUDIODRIVER, driver);
+
+		if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+			throw std::runtime_error(SDL_GetError());
+		}
+
 		SDL_AudioSpec desired{};
 
-		desired.freq = 48000;
+		desired.freq = std::lround(settings.sample_rate);
 		desired.format = AUDIO_F32;
-		desired.channels = 2;
-		desired.samples = 128;
+		desired.channels = channels;
+		desired.samples = settings.period;
 		desired.callback = callback;
-		desired.userdata = &Registry::get();
+		desired.userdata = this;
+
+		SDL_AudioSpec obtained{};
+		device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 
-		if (SDL_OpenAudio(&desired, nullptr) != 0) {
+		if (!device) {
+			SDL_QuitSubSystem(SDL_INIT_AUDIO);
 			throw std::runtime_error(SDL_GetError());
 		}
 
+		settings.sample_rate = obtained.freq;
+		settings.period = obtained.samples;
 	}
 
 	/**
 	 * The destructor.
 	 *
-	 * This will shut down SDL.
+	 * This will shut down the SDL audio subsystem.
 	 */
-	~Audio()
+	~SDLDevice()
 	{
-		SDL_Quit();
+		SDL_CloseAudioDevice(device);
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
 	}
-} audio;
 
-float Audio::left;
-float Audio::right;
+	void start() override
+	{
+		SDL_PauseAudioDevice(device, 0);
+	}
+
+	void stop() override
+	{
+		SDL_PauseAudioDevice(device, 1);
+
+		// Ensure the callback is no longer running
+		SDL_LockAudioDevice(device);
+		SDL_UnlockAudioDevice(device);
+	}
+
+	/**
+	 * The SDL audio callback.
+	 *
+	 * This function is called by SDL whenever a new chunk of samples needs to be sent to the audio card.
+	 *
+	 * @param userdata[in]  A pointer to the device object.
+	 * @param stream[out]   A pointer to the buffer where the audio samples must be written.
+	 * @param len           The length of the buffer in bytes.
+	 */
+	static void callback(void *userdata, uint8_t *stream, int len)
+	{
+		auto self = static_cast<SDLDevice *>(userdata);
+		float *ptr = reinterpret_cast<float *>(stream);
+
+		for (size_t c = 0; c < self->channels; c++) {
+			self->outputs[c] = ptr + c;
+		}
+
+		generate(self->outputs.data(), self->channels, self->channels, len / (self->channels * sizeof *ptr));
+	}
+};
+
+/**
+ * Audio output without a sound card.
+ *
+ * This generates audio in real time from its own thread, and discards it.
+ */
+struct NullDevice: Device {
+	std::size_t channels;         ///< The number of channels.
+	std::size_t period;           ///< The number of frames generated at a time.
+	std::vector<float> buffer;    ///< The buffer the audio is written to.
+	std::vector<float *> outputs; ///< Pointers to the first sample of each channel.
+	std::atomic<bool> quit{};     ///< Set when the thread should exit.
+	std::thread thread;           ///< The thread generating the audio.
+
+	/**
+	 * The constructor.
+	 *
+	 * @param settings  The settings to generate audio with.
+	 */
+	NullDevice(Settings &settings):
+		channels(settings.channels),
+		period(settings.period),
+		buffer(channels * period),
+		outputs(channels)
+	{
+		for (size_t c = 0; c < channels; c++) {
+			outputs[c] = buffer.data() + c;
+		}
+	}
+
+	~NullDevice()
+	{
+		stop();
+	}
+
+	void start() override
+	{
+		quit = false;
+		thread = std::thread([this] {
+			set_realtime_priority();
+			auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(period * sample_dt));
+			auto next = std::chrono::steady_clock::now();
+
+			while (!quit) {
+				generate(outputs.data(), channels, channels, period);
+				next += interval;
+				std::this_thread::sleep_until(next);
+			}
+		});
+	}
+
+	void stop() override
+	{
+		if (thread.joinable()) {
+			quit = true;
+			thread.join();
+		}
+	}
+};
+
+/**
+ * Open the audio output device selected by the settings.
+ *
+ * @param settings  The settings, which are updated with the actual sample rate and period size.
+ * @return          The opened device.
+ */
+std::unique_ptr<Device> open_device(Settings &settings)
+{
+	switch (settings.backend) {
+	case Backend::SDL:
+		return std::make_unique<SDLDevice>(settings, nullptr);
+
+	case Backend::PIPEWIRE:
+		return std::make_unique<SDLDevice>(settings, "pipewire");
+
+	case Backend::ALSA:
+#ifdef MODSYNTH_ALSA
+		return open_alsa(settings);
+#else
+		throw std::runtime_error("ALSA support was not compiled in");
+#endif
+
+	case Backend::JACK:
+#ifdef MODSYNTH_JACK
+		return open_jack(settings);
+#else
+		throw std::runtime_error("JACK support was not compiled in");
+#endif
+
+	case Backend::NONE:
+		return std::make_unique<NullDevice>(settings);
+	}
+
+	throw std::invalid_argument("unknown backend");
+}
+
+/**
+ * Change the sample rate.
+ *
+ * If the sample rate is different from the current one, all modules are
+ * prepared for the new sample rate. This must only be called while the audio
+ * output is not active.
+ *
+ * @param sample_rate  The new sample rate in Hz.
+ */
+void set_sample_rate(float sample_rate)
+{
+	float dt = 1.0f / sample_rate;
+	Module::dt = dt;
+
+	if (dt != sample_dt) {
+		sample_dt = dt;
+		Registry::get().prepare();
+	}
+}
+
+/**
+ * Get the human readable name of the type of a module.
+ *
+ * @param mod  The module.
+ * @return     The demangled name of the type of the module, if possible.
+ */
+std::string type_name(const Module *mod)
+{
+	const char *name = typeid(*mod).name();
+
+#ifdef __GNUG__
+	int status;
+	std::unique_ptr<char, decltype(&std::free)> demangled(abi::__cxa_demangle(name, nullptr, nullptr, &status), &std::free);
+
+	if (status == 0) {
+		return demangled.get();
+	}
+#endif
+
+	return name;
+}
 
-const float pi = 4.0f * std::atan(1.0f);
+/// The module whose default process() function is calling its update() function on this thread.
+thread_local const Module *defaulting;
 
 }
 
 Module::Module()
 {
 	auto &registry = Registry::get();
-	registry.modules.push_back(this);
+	registry.add(this);
+	Registry::constructing = this;
 }
 
 Module::~Module()
 {
 	auto &registry = Registry::get();
-	registry.modules.push_back(this);
+	registry.remove(this);
+
+	if (Registry::constructing == this) {
+		Registry::constructing = nullptr;
+	}
 }
 
-void VCO::update()
+Output::Output(float initial): owner(Registry::constructing)
 {
-	float phase = sawtooth_out * 0.5f - 0.5f;
-	phase += frequency * dt;
-	phase -= std::floor(phase);
+	std::fill_n(buffer, Module::max_block_size, initial);
+}
+
+Output::~Output()
+{
+	Registry::get().remove(this);
+}
+
+Input::Input(float value): value(value), owner(Registry::constructing)
+{
+}
+
+Input::~Input()
+{
+	Registry::get().remove(this);
+}
+
+void Input::connect(const Output &output)
+{
+	Registry::get().connect(this, &output);
+}
+
+void Input::disconnect()
+{
+	Registry::get().disconnect(this);
+}
 
-	sawtooth_out = phase * 2.0f - 1.0f;
-	sine_out = std::sin(phase * 2.0f * pi);
-	square_out = std::rint(phase) * -2.0f + 1.0f;
-	triangle_out = std::abs(phase - 0.5f) * 4.0f - 1.0f;
+Wire::Wire(const float &from, Input &to): from_value(&from), to_input(&to)
+{
+	Registry::get().write(this, &to);
 }
 
-void Envelope::update()
+void Module::update()
 {
-	if (gate_in <= 0.0f) {
-		state = RELEASE;
-	} else if (state == RELEASE) {
-		state = ATTACK;
+	// The defaults of update() and process() would otherwise call each other forever
+	if (defaulting == this) {
+		defaulting = nullptr;
+		throw std::logic_error(type_name(this) + " implements neither update() nor process()");
 	}
 
-	switch (state) {
-	case ATTACK:
-		amplitude_out += dt / attack;
+	process(1);
+}
 
-		if (amplitude_out >= 1.0f) {
-			amplitude_out = 1.0f;
-			state = DECAY;
-		}
+void Module::process(size_t frames)
+{
+	auto saved = defaulting;
+	defaulting = this;
 
-		break;
+	for (size_t i = 0; i < frames; i++) {
+		update();
+	}
 
-	case DECAY:
-		amplitude_out *= std::exp2(-dt / decay);
-		break;
+	defaulting = saved;
+}
 
-	case RELEASE:
-		amplitude_out *= std::exp2(-dt / release);
-		break;
+void Module::process_batch(Module *const *batch, size_t count, size_t frames)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (!batch[i]->asleep()) {
+			batch[i]->process(frames);
+		}
 	}
 }
 
-void VCA::update()
+bool Module::block_processing() const
 {
-	audio_out = audio_in * amplitude;
+	return false;
 }
 
-void VCF::update()
+void Module::prepare()
 {
-	float f = 2.0f * std::sin(std::min(pi * cutoff * dt, std::asin(0.5f)));
-	float q = 1.0f / resonance;
+}
 
-	lowpass_out += f * bandpass_out;
-	highpass_out = audio_in - q * bandpass_out - lowpass_out;
-	bandpass_out += f * highpass_out;
+bool Module::idle() const
+{
+	return false;
 }
 
-void LinearSlew::update()
+void Module::contain(Module &child, float scale)
 {
-	float delta = in - out;
+	// A parameter counts the time steps of the audio output, so it must run at that rate
+	if (scale != 1 && dynamic_cast<Parameter *>(&child)) {
+		throw std::invalid_argument("a Parameter cannot run at a different rate");
+	}
+
+	Registry::get().nest(&child, this, scale);
+}
 
-	if (delta > rate * dt) {
-		delta = rate * dt;
-	} else if (delta < -rate * dt) {
-		delta = -rate * dt;
+void Module::run_children(size_t frames)
+{
+	if (!children) {
+		return;
 	}
 
-	out += delta;
+	for (auto mod : *children) {
+		if (!mod->asleep()) {
+			Profiler::process(mod, frames);
+		}
+	}
 }
 
-void ExponentialSlew::update()
+namespace
 {
-	float delta = std::log2(in / out);
 
-	if (delta > rate * dt) {
-		delta = rate * dt;
-	} else if (delta < -rate * dt) {
-		delta = -rate * dt;
+/**
+ * The PolyBLEP residual of a unit step of height 2 at phase 0.
+ *
+ * @param phase      The phase, between 0 and 1.
+ * @param increment  The phase increment per time step, between 0 and 0.5.
+ * @return           The value to add to a waveform with a rising step at phase 0.
+ */
+float blep(float phase, float increment)
+{
+	if (phase < increment) {
+		float x = phase / increment;
+		return x + x - x * x - 1.0f;
+	} else if (phase > 1.0f - increment) {
+		float x = (phase - 1.0f) / increment;
+		return x * x + x + x + 1.0f;
+	} else {
+		return 0.0f;
 	}
+}
 
-	out *= std::exp2(delta);
+/**
+ * The PolyBLAMP residual of a change in slope of 2 per time step at phase 0.
+ *
+ * @param phase      The phase, between 0 and 1.
+ * @param increment  The phase increment per time step, between 0 and 0.5.
+ * @return           The value to add to a waveform whose slope increases at phase 0.
+ */
+float blamp(float phase, float increment)
+{
+	if (phase < increment) {
+		float x = phase / increment - 1.0f;
+		return x * x * x * (-1.0f / 3);
+	} else if (phase > 1.0f - increment) {
+		float x = (phase - 1.0f) / increment + 1.0f;
+		return x * x * x * (1.0f / 3);
+	} else {
+		return 0.0f;
+	}
 }
 
-Delay::Delay(float max_delay):
-	delay(max_delay),
-	buffer(size_t(std::ceil(max_delay / dt)) + 1)
+}
+
+void VCO::process(size_t frames)
 {
+	if (mode == BAND_LIMITED) {
+		return process_band_limited(frames);
+	}
+
+	for (size_t i = 0; i < frames; i++) {
+		phase += frequency[i] * dt;
+		phase -= std::floor(phase);
+
+		sawtooth_out[i] = phase * 2.0f - 1.0f;
+		sine_out[i] = std::sin(phase * 2.0f * pi);
+		square_out[i] = std::rint(phase) * -2.0f + 1.0f;
+		triangle_out[i] = std::abs(phase - 0.5f) * 4.0f - 1.0f;
+	}
 }
 
-void Delay::update()
+void VCO::process_band_limited(size_t frames)
 {
-	// Update the delay line
-	buffer.pop_back();
-	buffer.push_front(in);
+	bool sawtooth = sawtooth_out.connected();
+	bool sine = sine_out.connected();
+	bool square = square_out.connected();
+	bool triangle = triangle_out.connected();
+
+	for (size_t i = 0; i < frames; i++) {
+		float increment = frequency[i] * dt;
+		phase += increment;
+		phase -= std::floor(phase);
+
+		// The residuals are symmetric, so they work for negative frequencies as well
+		increment = std::min(std::abs(increment), 0.5f);
+		float opposite = phase < 0.5f ? phase + 0.5f : phase - 0.5f;
+
+		if (sawtooth) {
+			sawtooth_out[i] = phase * 2.0f - 1.0f - blep(phase, increment);
+		}
+
+		if (sine) {
+			sine_out[i] = fast_sine(phase);
+		}
 
-	// Clamp delay to the supported range
-	auto nsamples = buffer.size() - 1;
+		if (square) {
+			square_out[i] = std::rint(phase) * -2.0f + 1.0f + blep(phase, increment) - blep(opposite, increment);
+		}
 
-	if (delay < 0) {
-		delay = 0;
+		if (triangle) {
+			float slope = 4.0f * increment;
+			triangle_out[i] = std::abs(phase - 0.5f) * 4.0f - 1.0f - slope * blamp(phase, increment) + slope * blamp(opposite, increment);
+		}
 	}
+}
+
+void Envelope::process(size_t frames)
+{
+	float peak = amplitude;
 
-	if (delay > nsamples * dt) {
-		delay = nsamples * dt;
+	for (size_t i = 0; i < frames; i++) {
+		if (gate_in[i] <= 0.0f) {
+			state = RELEASE;
+		} else if (state == RELEASE) {
+			state = ATTACK;
+		}
+
+		switch (state) {
+		case ATTACK:
+			amplitude += attack_step(attack[i], [](float time) { return dt / time; });
+
+			if (amplitude >= 1.0f) {
+				amplitude = 1.0f;
+				state = DECAY;
+			}
+
+			break;
+
+		case DECAY:
+			amplitude *= decay_factor(decay[i], [](float time) { return std::exp2(-dt / time); });
+			break;
+
+		case RELEASE:
+			amplitude *= release_factor(release[i], [](float time) { return std::exp2(-dt / time); });
+			break;
+		}
+
+		// Stop decaying before reaching the denormal range
+		if (amplitude < silence) {
+			amplitude = 0.0f;
+		}
+
+		peak = std::max(peak, amplitude);
+		amplitude_out[i] = amplitude;
 	}
 
-	// Linear interpolation of the value at the delay position
-	size_t pos = delay / dt;
-	float fraction = delay / dt - pos;
-	out = buffer[pos] * (1 - fraction) + buffer[pos + 1] * fraction;
+	silent_blocks = peak == 0.0f ? std::min(silent_blocks + 1, 2) : 0;
 }
 
-Sequencer::Sequencer(std::initializer_list<std::string> notes)
+void VCA::process(size_t frames)
 {
-	static const std::map<std::string, int> base_notes = {
-		{"Cb", -1}, {"C", 0}, {"C#", 1},
-		{"Db", 1}, {"D", 2}, {"D#", 3},
-		{"Eb", 3}, {"E", 4}, {"E#", 5},
-		{"Fb", 4}, {"F", 5}, {"F#", 6},
-		{"Gb", 6}, {"G", 7}, {"G#", 8},
-		{"Ab", 8}, {"A", 9}, {"A#", 10},
-		{"Bb", 10}, {"B", 11}, {"B#", 12},
-	};
+	if (amplitude.constant()) {
+		float a = amplitude[0];
 
-	for (auto &note : notes) {
-		auto octave_pos = note.find_first_of("0123456789");
-		auto base_note = base_notes.at(note.substr(0, octave_pos));
-		auto octave = std::stoi(note.substr(octave_pos));
-		frequencies.push_back(440.0f * std::exp2((base_note - 9) / 12.0f + octave - 4));
+		for (size_t i = 0; i < frames; i++) {
+			audio_out[i] = audio_in[i] * a;
+		}
+
+		return;
 	}
 
-	index = frequencies.size() - 1;
+	for (size_t i = 0; i < frames; i++) {
+		audio_out[i] = audio_in[i] * amplitude[i];
+	}
 }
 
-void Sequencer::update()
+void VCF::process(size_t frames)
 {
-	if (clock_in > 0 && !gate_out) {
-		index++;
-		index %= frequencies.size();
+	auto frequency = [](float cutoff) {
+		return 2.0f * std::sin(std::min(pi * cutoff * dt, std::asin(0.5f)));
+	};
+
+	// Only calculate the coefficients once if the parameters are constant during this block
+	bool constant = cutoff.constant() && resonance.constant();
+	float f = frequency(cutoff[0]);
+	float q = 1.0f / resonance[0];
+
+	for (size_t i = 0; i < frames; i++) {
+		if (!constant) {
+			f = frequency(cutoff[i]);
+			q = 1.0f / resonance[i];
+		}
+
+		lowpass += f * bandpass;
+		float highpass = audio_in[i] - q * bandpass - lowpass;
+		bandpass += f * highpass;
+
+		lowpass_out[i] = lowpass;
+		bandpass_out[i] = bandpass;
+		highpass_out[i] = highpass;
 	}
 
-	frequency_out = frequencies[index];
-	gate_out = clock_in > 0;
+	// Once the filter has rung out, stop it from decaying into the denormal range
+	if (std::abs(lowpass) < silence && std::abs(bandpass) < silence) {
+		lowpass = 0.0f;
+		bandpass = 0.0f;
+	}
+}
+
+void LinearSlew::process(size_t frames)
+{
+	for (size_t i = 0; i < frames; i++) {
+		float delta = in[i] - value;
+		float max_delta = rate[i] * dt;
+
+		if (delta > max_delta) {
+			delta = max_delta;
+		} else if (delta < -max_delta) {
+			delta = -max_delta;
+		}
+
+		value += delta;
+		out[i] = value;
+	}
 }
 
-void Speaker::update()
+void ExponentialSlew::process(size_t frames)
 {
-	audio.left += left_in;
-	audio.right += right_in;
+	for (size_t i = 0; i < frames; i++) {
+		float factor = max_factor(rate[i], [](float rate) { return std::exp2(rate * dt); });
+		float ratio = in[i] / value;
+
+		// Compare ratios instead of their logarithms
+		if (ratio > factor) {
+			value *= factor;
+		} else if (ratio * factor < 1.0f) {
+			value /= factor;
+		} else {
+			value = in[i];
+		}
+
+		out[i] = value;
+	}
 }
 
-void Wire::update()
+DelayLine::DelayLine(float max_delay): max_delay(max_delay)
 {
-	to = from;
+	prepare();
 }
 
-void start()
+/**
+ * Allocate the buffer for the current sample rate.
+ *
+ * This clears the history.
+ */
+void DelayLine::prepare()
 {
-	SDL_PauseAudio(0);
+	max_samples = std::ceil(max_delay / Module::dt);
+
+	// Room for the interpolator's neighbours, and for a whole block written before it is read
+	size_t size = 1;
+
+	while (size < max_samples + 3 + Module::max_block_size) {
+		size *= 2;
+	}
+
+	buffer.assign(size, 0.0f);
+	mask = size - 1;
+	position = 0;
 }
 
-void stop()
+/**
+ * Append a block of values to the history.
+ *
+ * @param in      The input signal to store.
+ * @param frames  The number of time steps to store.
+ */
+void DelayLine::write(const Input &in, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++) {
+		buffer[(position + i) & mask] = in[i];
+	}
+
+	position = (position + frames) & mask;
+}
+
+/**
+ * Read the delayed values corresponding to the most recently written block.
+ *
+ * A delay of zero gives the value written for the same time step. Delays are
+ * clamped to the range supported by the delay line.
+ *
+ * @param delay          The delay in seconds.
+ * @param out            The output to write the delayed values to.
+ * @param frames         The number of time steps, the same as passed to write().
+ * @param interpolation  How to read values between time steps.
+ * @param state          The state of the allpass interpolator.
+ */
+void DelayLine::read(const Input &delay, Output &out, size_t frames, Interpolation interpolation, float &state) const
+{
+	auto start = position - frames;
+
+	// The value written @p samples time steps before time step @p i of the block
+	auto at = [&](size_t i, size_t samples) {
+		return buffer[(start + i - samples) & mask];
+	};
+
+	switch (interpolation) {
+	case Interpolation::NONE:
+		for (size_t i = 0; i < frames; i++) {
+			float time = std::min(std::max(delay[i] / Module::dt, 0.0f), float(max_samples));
+			out[i] = at(i, time + 0.5f);
+		}
+
+		break;
+
+	case Interpolation::LINEAR:
+		for (size_t i = 0; i < frames; i++) {
+			float time = std::min(std::max(delay[i] / Module::dt, 0.0f), float(max_samples));
+			size_t pos = time;
+			float fraction = time - pos;
+			out[i] = at(i, pos) * (1 - fraction) + at(i, std::min(pos + 1, max_samples)) * fraction;
+		}
+
+		break;
+
+	case Interpolation::CUBIC:
+		for (size_t i = 0; i < frames; i++) {
+			float time = std::min(std::max(delay[i] / Module::dt, 0.0f), float(max_samples));
+			size_t pos = time;
+			float t = time - pos;
+
+			// There is no value newer than the current time step
+			float xm1 = at(i, pos ? pos - 1 : 0);
+			float x0 = at(i, pos);
+			float x1 = at(i, pos + 1);
+			float x2 = at(i, pos + 2);
+
+			float c1 = 0.5f * (x1 - xm1);
+			float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+			float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+			out[i] = ((c3 * t + c2) * t + c1) * t + x0;
+		}
+
+		break;
+
+	case Interpolation::ALLPASS:
+		for (size_t i = 0; i < frames; i++) {
+			float time = std::min(std::max(delay[i] / Module::dt, 0.0f), float(max_samples));
+			size_t pos = time;
+			float fraction = time - pos;
+
+			// The interpolator is best behaved for fractional delays between 0.5 and 1.5
+			if (fraction < 0.5f && pos) {
+				pos--;
+				fraction += 1;
+			}
+
+			float eta = (1 - fraction) / (1 + fraction);
+			state = eta * (at(i, pos) - state) + at(i, pos + 1);
+			out[i] = state;
+		}
+
+		break;
+	}
+}
+
+Delay::Delay(float max_delay, Interpolation interpolation):
+	delay(max_delay),
+	interpolation(interpolation),
+	line(max_delay)
+{
+}
+
+void Delay::process(size_t frames)
+{
+	line.write(in, frames);
+	line.read(delay, out, frames, interpolation, state);
+}
+
+void Delay::prepare()
+{
+	line.prepare();
+}
+
+MultiTapDelay::MultiTapDelay(size_t taps, float max_delay, Interpolation interpolation):
+	delay(taps),
+	out(taps),
+	interpolation(interpolation),
+	line(max_delay),
+	state(taps)
+{
+	for (auto &input : delay) {
+		input = max_delay;
+	}
+}
+
+void MultiTapDelay::process(size_t frames)
+{
+	line.write(in, frames);
+
+	for (size_t tap = 0; tap < delay.size(); tap++) {
+		line.read(delay[tap], out[tap], frames, interpolation, state[tap]);
+	}
+}
+
+void MultiTapDelay::prepare()
+{
+	line.prepare();
+}
+
+Sequencer::Sequencer(const std::vector<std::string> &notes)
+{
+	for (auto &note : notes) {
+		frequencies.push_back(note_frequency(note));
+	}
+
+	index = frequencies.size() - 1;
+}
+
+bool Sequencer::play(const float *pattern, size_t steps)
+{
+	if (!steps) {
+		throw std::invalid_argument("a pattern needs at least one note");
+	}
+
+	return next.push({pattern, steps});
+}
+
+/**
+ * Go to the next step, switching to the most recently queued pattern if there is one.
+ */
+void Sequencer::advance()
+{
+	bool switched = false;
+
+	for (Pattern queued; next.pop(queued);) {
+		pattern = queued;
+		switched = true;
+	}
+
+	if (switched) {
+		index = 0;
+	} else {
+		index++;
+		index %= pattern.frequencies ? pattern.steps : frequencies.size();
+	}
+}
+
+void Sequencer::process(size_t frames)
+{
+	if (!(tempo[0] > 0)) {
+		for (size_t i = 0; i < frames; i++) {
+			bool clock = clock_in[i] > 0;
+
+			if (clock && !gate) {
+				advance();
+			}
+
+			gate = clock;
+			frequency_out[i] = pattern.frequencies ? pattern.frequencies[index] : frequencies[index];
+			gate_out[i] = gate;
+		}
+
+		return;
+	}
+
+	// Module::dt is a float, recover the integer sample rate it was derived from to avoid drifting
+	double rate = 1 / double(dt);
+
+	if (std::abs(rate - std::round(rate)) < rate * 1e-6) {
+		rate = std::round(rate);
+	}
+
+	double length = 60 * rate / tempo[0];
+
+	// A step cannot be shorter than one time step, this also catches an infinite tempo
+	if (!std::isfinite(length) || length < 1) {
+		length = 1;
+	}
+
+	double high = length * std::clamp(gate_length[0], 0.0f, 1.0f);
+
+	for (size_t i = 0; i < frames;) {
+		while (until_step <= 0) {
+			until_step += length;
+			advance();
+		}
+
+		// Fill the outputs up to the next time step either of them changes
+		double until_low = until_step - (length - high);
+		gate = until_low > 0;
+		auto span = std::min(frames - i, static_cast<size_t>(std::ceil(gate ? until_low : until_step)));
+		auto frequency = pattern.frequencies ? pattern.frequencies[index] : frequencies[index];
+
+		std::fill_n(&frequency_out[i], span, frequency);
+		std::fill_n(&gate_out[i], span, gate);
+		i += span;
+		until_step -= span;
+	}
+}
+
+void Speaker::process(size_t frames)
+{
+	audio.add(left_in, channel, frames);
+	audio.add(right_in, channel + 1, frames);
+}
+
+MultichannelSpeaker::MultichannelSpeaker(size_t channels, size_t first): in(channels), first(first)
+{
+}
+
+void MultichannelSpeaker::process(size_t frames)
+{
+	for (size_t c = 0; c < in.size(); c++) {
+		audio.add(in[c], first + c, frames);
+	}
+}
+
+Wire::Wire(const Output &from, float &to): from_output(&from), to_value(&to)
+{
+	Registry::get().read(this, &from);
+}
+
+Wire::Wire(const Output &from, Input &to)
+{
+	to.connect(from);
+
+	// The input reads directly from the output, so there is nothing to update
+	auto &registry = Registry::get();
+	registry.remove(this);
+}
+
+void Wire::process(size_t frames)
+{
+	if (to_input) {
+		*to_input = *from_value;
+	} else {
+		for (size_t i = 0; i < frames; i++) {
+			*to_value = from_output ? (*from_output)[i] : *from_value;
+		}
+	}
+}
+
+bool Wire::block_processing() const
+{
+	// Plain floats can only hold the value of a single time step
+	return to_input;
+}
+
+Parameter::Parameter(Input &target, float value): target(target), value(value)
+{
+	target = value;
+	Registry::get().write(this, &target);
+}
+
+bool Parameter::set(float value, float ramp, double time)
+{
+	return events.push({time, value, ramp});
+}
+
+void Parameter::process(size_t frames)
+{
+	auto start = generated.load(std::memory_order_relaxed);
+	bool constant = !steps;
+
+	for (size_t i = 0; i < frames;) {
+		// Start the changes that are due at this time step
+		while (waiting || events.pop(next)) {
+			if (!waiting) {
+				waiting = true;
+				next_frame = next.time > 0 ? std::llround(next.time / double(sample_dt)) : 0;
+			}
+
+			if (next_frame > start + i) {
+				break;
+			}
+
+			waiting = false;
+			steps = std::lround(next.ramp / dt);
+			end = next.value;
+
+			if (steps) {
+				step = (end - value) / steps;
+			} else {
+				value = end;
+			}
+
+			// Only a jump at the start of the block keeps it constant
+			constant = constant && !steps && !i;
+		}
+
+		size_t until = waiting ? std::min<std::uint64_t>(frames, next_frame - start) : frames;
+
+		if (!steps) {
+			std::fill(buffer + i, buffer + until, value);
+			i = until;
+			continue;
+		}
+
+		for (; i < until && steps; i++) {
+			value = --steps ? value + step : end;
+			buffer[i] = value;
+		}
+	}
+
+	if (constant) {
+		target.value = value;
+		target.buffer = nullptr;
+	} else {
+		target.buffer = buffer;
+	}
+}
+
+double audio_time()
+{
+	return generated.load(std::memory_order_relaxed) * double(sample_dt);
+}
+
+Meter::Meter(float interval): interval(interval)
+{
+	prepare();
+}
+
+bool Meter::read(Level &level)
+{
+	return levels.pop(level);
+}
+
+void Meter::prepare()
+{
+	length = std::max(1l, std::lround(interval / dt));
+	count = std::min(count, length - 1);
+}
+
+void Meter::process(size_t frames)
+{
+	for (size_t i = 0; i < frames;) {
+		size_t n = std::min(frames - i, length - count);
+
+		for (size_t end = i + n; i < end; i++) {
+			float value = in[i];
+			peak = std::max(peak, std::abs(value));
+			sum += value * value;
+		}
+
+		count += n;
+
+		if (count == length) {
+			levels.push({audio_time() + i * double(dt), peak, float(std::sqrt(sum / length))});
+			count = 0;
+			peak = 0;
+			sum = 0;
+		}
+	}
+}
+
+MPSCQueue<Changes::Change, Changes::queue_size> Changes::queue;
+
+Changes &Changes::set(Input &input, float value)
+{
+	add({&input, nullptr, value, false, 0});
+	return *this;
+}
+
+Changes &Changes::enable(Module &mod, bool enabled)
+{
+	add({nullptr, &mod, 0, enabled, 0});
+	return *this;
+}
+
+/**
+ * Add a change to this batch.
+ *
+ * A batch is pushed to the queue in one go, so it can never be sent if it is
+ * larger than the queue.
+ *
+ * @param change  The change to add.
+ * @throw std::length_error if the batch already holds queue_size changes.
+ */
+void Changes::add(const Change &change)
+{
+	if (changes.size() >= queue_size) {
+		throw std::length_error("too many changes in one batch");
+	}
+
+	changes.push_back(change);
+}
+
+bool Changes::send()
+{
+	if (changes.empty()) {
+		return true;
+	}
+
+	changes[0].count = changes.size();
+
+	if (!queue.push(changes.data(), changes.size())) {
+		return false;
+	}
+
+	changes.clear();
+	return true;
+}
+
+/**
+ * Apply all batches of changes that have been sent completely.
+ *
+ * This is called by the audio thread at the start of every block.
+ */
+void Changes::receive()
+{
+	while (auto first = queue.front()) {
+		// Another thread might still be writing the rest of the batch
+		if (!queue.available(first->count)) {
+			break;
+		}
+
+		for (auto count = first->count; count; count--) {
+			Change change{};
+			queue.pop(change);
+
+			if (change.input) {
+				change.input->value = change.value;
+			} else {
+				change.mod->disabled = !change.enabled;
+			}
+		}
+	}
+}
+
+/**
+ * The coefficients of the half-band filter.
+ *
+ * These are the odd taps of a windowed sinc lowpass filter with a cutoff at a
+ * quarter of the higher sample rate, using a Blackman window. The center tap
+ * is exactly one half, and is applied separately to the even phase.
+ */
+const std::array<float, 2 * Oversampler::HalfBand::taps> Oversampler::HalfBand::coefficients = [] {
+	std::array<float, 2 * taps> coefficients;
+	double sum = 0;
+
+	for (size_t i = 0; i < 2 * taps; i++) {
+		double m = 2.0 * i + 1.0 - 2.0 * taps;
+		double window = 0.42 + 0.5 * std::cos(pi * m / (2 * taps)) + 0.08 * std::cos(2 * pi * m / (2 * taps));
+		coefficients[i] = window * std::sin(pi * m / 2) / (pi * m);
+		sum += coefficients[i];
+	}
+
+	for (auto &coefficient : coefficients) {
+		coefficient /= sum;
+	}
+
+	return coefficients;
+}();
+
+/**
+ * Double the sample rate of a signal.
+ *
+ * The even output samples are the input delayed by #taps time steps, the odd
+ * output samples are interpolated halfway between them.
+ *
+ * @param in      The input signal.
+ * @param out     The output signal, which receives 2 * @p frames values.
+ * @param frames  The number of input values, at most half of Module::max_block_size.
+ */
+void Oversampler::HalfBand::upsample(const float *in, float *out, size_t frames)
+{
+	float x[2 * taps + max_block_size / 2];
+	std::copy_n(even, 2 * taps, x);
+	std::copy_n(in, frames, x + 2 * taps);
+
+	for (size_t n = 0; n < frames; n++) {
+		// The oldest value that needs to be read is at index n + 1
+		const float *p = x + n + 1;
+		float sum = 0;
+
+		for (size_t i = 0; i < 2 * taps; i++) {
+			sum += coefficients[i] * p[2 * taps - 1 - i];
+		}
+
+		out[2 * n] = p[taps - 1];
+		out[2 * n + 1] = sum;
+	}
+
+	std::copy_n(x + frames, 2 * taps, even);
+}
+
+/**
+ * Halve the sample rate of a signal.
+ *
+ * @param in      The input signal, containing 2 * @p frames values.
+ * @param out     The output signal, delayed by #taps time steps.
+ * @param frames  The number of output values, at most half of Module::max_block_size.
+ */
+void Oversampler::HalfBand::downsample(const float *in, float *out, size_t frames)
+{
+	float e[2 * taps + max_block_size / 2];
+	float o[2 * taps + max_block_size / 2];
+	std::copy_n(even, 2 * taps, e);
+	std::copy_n(odd, 2 * taps, o);
+
+	for (size_t n = 0; n < frames; n++) {
+		e[2 * taps + n] = in[2 * n];
+		o[2 * taps + n] = in[2 * n + 1];
+	}
+
+	for (size_t n = 0; n < frames; n++) {
+		// The odd phase lags the even phase by half a time step
+		const float *p = o + n;
+		float sum = 0;
+
+		for (size_t i = 0; i < 2 * taps; i++) {
+			sum += coefficients[i] * p[2 * taps - 1 - i];
+		}
+
+		out[n] = 0.5f * (e[n + taps] + sum);
+	}
+
+	std::copy_n(e + frames, 2 * taps, even);
+	std::copy_n(o + frames, 2 * taps, odd);
+}
+
+Oversampler::Oversampler(size_t factor, size_t inputs, size_t outputs, std::initializer_list<Module *> modules):
+	in(inputs),
+	inner_out(outputs),
+	inner_in(inputs),
+	out(outputs),
+	factor(factor),
+	stages(std::countr_zero(factor)),
+	up(inputs * stages),
+	down(outputs * stages)
+{
+	if (factor != 2 && factor != 4 && factor != 8) {
+		throw std::invalid_argument("oversampling factor must be 2, 4 or 8");
+	}
+
+	for (auto mod : modules) {
+		if (!mod->block_processing()) {
+			throw std::invalid_argument("oversampled modules must implement process()");
+		}
+
+		contain(*mod, 1.0f / factor);
+	}
+}
+
+void Oversampler::process(size_t frames)
+{
+	size_t chunk = max_block_size / factor;
+
+	for (size_t offset = 0; offset < frames; offset += chunk) {
+		size_t n = std::min(chunk, frames - offset);
+		float a[max_block_size];
+		float b[max_block_size];
+
+		for (size_t i = 0; i < in.size(); i++) {
+			for (size_t j = 0; j < n; j++) {
+				a[j] = in[i][offset + j];
+			}
+
+			// Double the rate in every stage, the last one writes directly to the nested modules
+			auto src = a;
+			auto dst = b;
+
+			for (size_t stage = 0; stage < stages; stage++) {
+				if (stage == stages - 1) {
+					dst = inner_in[i].buffer;
+				}
+
+				up[i * stages + stage].upsample(src, dst, n << stage);
+				std::swap(src, dst);
+			}
+		}
+
+		auto saved = dt;
+		dt = saved / factor;
+		run_children(n * factor);
+		dt = saved;
+
+		for (size_t i = 0; i < out.size(); i++) {
+			for (size_t j = 0; j < n * factor; j++) {
+				a[j] = inner_out[i][j];
+			}
+
+			// Halve the rate in every stage, the last one writes directly to the output
+			auto src = a;
+			auto dst = b;
+
+			for (size_t stage = 0; stage < stages; stage++) {
+				if (stage == stages - 1) {
+					dst = out[i].buffer + offset;
+				}
+
+				down[i * stages + stage].downsample(src, dst, (n * factor) >> (stage + 1));
+				std::swap(src, dst);
+			}
+		}
+	}
+}
+
+ControlRate::ControlRate(size_t factor, size_t inputs, size_t outputs, std::initializer_list<Module *> modules):
+	in(inputs),
+	inner_out(outputs),
+	inner_in(inputs),
+	out(outputs),
+	factor(factor),
+	from(outputs),
+	to(outputs)
+{
+	if (factor < 2 || factor > max_block_size) {
+		throw std::invalid_argument("control rate factor must be between 2 and the maximum block size");
+	}
+
+	for (auto mod : modules) {
+		contain(*mod, factor);
+	}
+}
+
+void ControlRate::process(size_t frames)
+{
+	// Control steps start at fixed multiples of the factor, regardless of the block size
+	size_t first = (factor - position) % factor;
+	size_t steps = first < frames ? (frames - first + factor - 1) / factor : 0;
+
+	for (size_t i = 0; i < in.size(); i++) {
+		for (size_t j = 0; j < steps; j++) {
+			inner_in[i][j] = in[i][first + j * factor];
+		}
+	}
+
+	if (steps) {
+		auto saved = dt;
+		dt = saved * factor;
+		run_children(steps);
+		dt = saved;
+	}
+
+	// Ramp from the previous to the latest value of every control step
+	float scale = 1.0f / factor;
+
+	for (size_t i = 0; i < out.size(); i++) {
+		float a = from[i];
+		float b = to[i];
+		size_t step = 0;
+
+		for (size_t t = 0, p = position; t < frames;) {
+			if (p == 0) {
+				a = b;
+				b = inner_out[i][step++];
+			}
+
+			size_t n = std::min(frames - t, factor - p);
+			float slope = (b - a) * scale;
+			float *ptr = out[i].buffer + t - p;
+
+			for (size_t r = p + 1; r <= p + n; r++) {
+				ptr[r - 1] = a + slope * r;
+			}
+
+			// Land exactly on the value at the end of the control step
+			p += n;
+			t += n;
+
+			if (p == factor) {
+				ptr[p - 1] = b;
+				p = 0;
+			}
+		}
+
+		from[i] = a;
+		to[i] = b;
+	}
+
+	position = (position + frames) % factor;
+}
+
+void generate(float *const *outputs, size_t channels, size_t stride, size_t frames)
+{
+	auto &registry = Registry::get();
+
+	// The audio thread is not always created by us, so set these on every call
+	DenormalGuard denormals;
+	Module::dt = sample_dt;
+	registry.adopt();
+
+	bool profiling = Profiler::enabled.load(std::memory_order_relaxed);
+	auto start = profiling ? Profiler::now() : 0;
+
+	// Split into blocks, unless one of the modules only supports being updated one time step at a time
+	size_t block_size = registry.current && registry.current->block_processing ? Module::max_block_size : 1;
+
+	for (size_t offset = 0; offset < frames;) {
+		size_t n = std::min(frames - offset, block_size);
+
+		Changes::receive();
+		registry.run(n);
+		generated.store(generated.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+
+		audio.mix(outputs, channels, stride, offset, n);
+		offset += n;
+	}
+
+	// Let other processes see exactly what is sent to the audio output
+	if (registry.current && registry.current->tap) {
+		registry.current->tap->write(frames, [&](size_t c, size_t i) {
+			return c < channels ? outputs[c][i * stride] : 0.0f;
+		});
+	}
+
+	if (profiling) {
+		Profiler::callback(start, frames);
+	}
+}
+
+void start(const Settings &settings)
+{
+	auto &registry = Registry::get();
+	stop();
+
+	auto actual = settings;
+	audio.device = open_device(actual);
+	set_sample_rate(actual.sample_rate);
+
+	registry.commit();
+	registry.executor.start(settings.threads);
+	audio.configure(actual, actual.channels);
+	registry.set_running(true);
+	audio.device->start();
+}
+
+void stop()
+{
+	if (!audio.device) {
+		return;
+	}
+
+	audio.device->stop();
+	audio.device.reset();
+
+	auto &registry = Registry::get();
+	registry.set_running(false);
+	registry.executor.stop();
+}
+
+void render(float seconds, Sink &sink, const Settings &settings)
+{
+	auto &registry = Registry::get();
+
+	if (registry.running) {
+		throw std::logic_error("cannot render while the audio output is active");
+	}
+
+	set_sample_rate(settings.sample_rate);
+	registry.commit();
+	registry.executor.start(settings.threads);
+	audio.configure(settings, 2);
+
+	// The calling thread acts as the audio thread until all frames are rendered
+	registry.set_running(true);
+
+	float buffer[2 * Module::max_block_size];
+	float *const outputs[] = {buffer, buffer + 1};
+	size_t frames = std::lround(seconds / Module::dt);
+
+	try {
+		while (frames) {
+			size_t n = std::min(frames, Module::max_block_size);
+			generate(outputs, 2, 2, n);
+			sink.write(buffer, n);
+			frames -= n;
+		}
+	} catch (...) {
+		registry.set_running(false);
+		registry.executor.stop();
+		throw;
+	}
+
+	registry.set_running(false);
+	registry.executor.stop();
+}
+
+void set_profiling(bool enabled)
+{
+	Profiler::enabled = enabled;
+}
+
+Profile profile()
+{
+	Profile result{};
+
+	result.callbacks = Profiler::callbacks.load(std::memory_order_relaxed);
+	result.frames = Profiler::frames.load(std::memory_order_relaxed);
+	result.time = Profiler::time.load(std::memory_order_relaxed);
+	result.max_time = Profiler::max_time.load(std::memory_order_relaxed);
+	result.deadline_misses = Profiler::deadline_misses.load(std::memory_order_relaxed);
+	result.xruns = Profiler::xruns.load(std::memory_order_relaxed);
+
+	for (size_t i = 0; i < Profile::buckets; i++) {
+		result.histogram[i] = Profiler::histogram[i].load(std::memory_order_relaxed);
+	}
+
+	// The list of modules is only used by control threads, so locking it does not affect the audio thread
+	auto &registry = Registry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	std::map<std::string, TypeProfile> types;
+
+	for (auto mod : registry.modules) {
+		auto &stats = result.modules.emplace_back(Profiler::get(mod, type_name(mod)));
+		auto &type = types.try_emplace(stats.type, TypeProfile{stats.type, 0, 0, 0, 0}).first->second;
+		type.modules++;
+		type.calls += stats.calls;
+		type.time += stats.time;
+		type.max_time = std::max(type.max_time, stats.max_time);
+	}
+
+	for (auto &[name, type] : types) {
+		result.types.push_back(std::move(type));
+	}
+
+	std::stable_sort(result.types.begin(), result.types.end(), [](auto &a, auto &b) { return a.time > b.time; });
+
+	return result;
+}
+
+void sleep_while_idle(const Module &controller, std::initializer_list<Module *> modules)
+{
+	auto &registry = Registry::get();
+
+	for (auto mod : modules) {
+		registry.sleep(mod, &controller);
+	}
+}
+
+void commit()
+{
+	Registry::get().commit();
+}
+
+void remove(void *object, size_t size, void (*destroy)(void *))
 {
-	SDL_PauseAudio(1);
+	Registry::get().remove(object, size, destroy);
 }
 
 }
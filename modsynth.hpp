@@ -2,14 +2,26 @@
 
 #pragma once
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "queue.hpp"
+
 namespace ModSynth
 {
 
+struct Registry;
+struct Profiler;
+
 /**
  * @brief The base class for all modules.
  *
@@ -18,6 +30,11 @@ namespace ModSynth
  * ensure that the derived objects will be registered in the module registry,
  * and when audio output is started using the start() function, the update()
  * member function of each module will be called once for each time step.
+ *
+ * Modules can instead implement process(), which handles a whole block of time
+ * steps in one call. If all registered modules do so, audio is generated one
+ * block at a time, avoiding the overhead of calling each module for every
+ * single time step.
  */
 struct Module {
 	/**
@@ -27,7 +44,9 @@ struct Module {
 	 * for every time step. Since this is the constructor of the base class, any
 	 * member variables in the derived class will not have been initialized yet.
 	 * You must therefore ensure that the whole object is completely initialized
-	 * before calling the global start() function.
+	 * before calling the global start() function. Modules constructed while
+	 * audio output is active are only run after calling the global commit()
+	 * function.
 	 */
 	Module();
 
@@ -38,8 +57,11 @@ struct Module {
 	 * @brief The destructor.
 	 *
 	 * This will deregister the module, so its update() function will no longer
-	 * called for every time step. The object should not be destroyed while the
-	 * audio output is still active.
+	 * called for every time step. If the audio output is active, this waits
+	 * until the audio thread no longer uses the module. However, members of
+	 * the derived class are already destroyed at that point, so to safely
+	 * remove modules while the audio output is active, use the global remove()
+	 * function instead.
 	 */
 	virtual ~Module();
 
@@ -47,15 +69,348 @@ struct Module {
 	 * @brief The update function.
 	 *
 	 * This function is called every time step. The derived class must implement
-	 * this, and it should update all the output values according to the input
-	 * values and any other state it might have.
+	 * either this function or process(), and it should update all the output
+	 * values according to the input values and any other state it might have.
+	 * The default implementation calls process() for a single time step. If
+	 * the derived class implements neither function, it throws
+	 * std::logic_error.
+	 */
+	virtual void update();
+
+	/**
+	 * @brief The block processing function.
+	 *
+	 * This function is called once for every block of time steps. It should
+	 * do the same as calling update() @p frames times, but the derived class
+	 * can implement it more efficiently by processing all the samples of the
+	 * Input and Output buffers in one go. The default implementation calls
+	 * update() @p frames times.
+	 *
+	 * @param frames  The number of time steps to process, at most #max_block_size.
+	 */
+	virtual void process(std::size_t frames);
+
+	/**
+	 * @brief The batch processing function.
+	 *
+	 * The audio thread runs modules of the same type that do not depend on
+	 * each other one after the other, by calling this function on the first
+	 * module of such a batch. A derived class can override this to process
+	 * all of them in a single loop. The default implementation calls
+	 * process() for every module in the batch that is not sleeping.
+	 *
+	 * @param batch   The modules to run, all of the same type as this one, starting with this one.
+	 * @param count   The number of modules in the batch.
+	 * @param frames  The number of time steps to process, at most #max_block_size.
+	 */
+	virtual void process_batch(Module *const *batch, std::size_t count, std::size_t frames);
+
+	/**
+	 * @brief Whether this module natively processes blocks.
+	 *
+	 * A derived class that implements process() should override this and
+	 * return true. If any registered module returns false, which is the
+	 * default, all modules will be run one time step at a time, so that
+	 * routing done in update() functions keeps its exact timing.
+	 *
+	 * @return True if process() can be called with more than one frame.
+	 */
+	virtual bool block_processing() const;
+
+	/**
+	 * @brief Prepare for a new sample rate.
+	 *
+	 * This function is called when the sample rate changes, which only happens
+	 * while the audio output is not active. A derived class that allocates
+	 * memory or derives other values from #dt when it is constructed should
+	 * override this and recalculate them. The default implementation does
+	 * nothing.
 	 */
-	virtual void update() = 0;
+	virtual void prepare();
+
+	/**
+	 * @brief Whether this module is idle.
+	 *
+	 * A module is idle if its outputs are silent, and will stay silent until
+	 * its inputs change. Modules can be put to sleep while another module is
+	 * idle using sleep_while_idle(). The default implementation returns false.
+	 *
+	 * @return True if this module is idle.
+	 */
+	virtual bool idle() const;
+
+	/**
+	 * @brief Whether this module is sleeping.
+	 *
+	 * A sleeping module is skipped by the audio thread, so its outputs keep the
+	 * values of the last block it was run.
+	 *
+	 * @return True if the module was disabled using Changes, or the module this module sleeps with is idle.
+	 */
+	bool asleep() const
+	{
+		return disabled || (controller && controller->idle());
+	}
 
 	/**
 	 * @brief The time step used for the update function in seconds.
+	 *
+	 * This is the inverse of the sample rate of the audio output, and is only
+	 * changed by start() and render() while the audio output is not active.
+	 * It is thread-local, so modules run by an Oversampler see a smaller time
+	 * step. The audio thread, the worker threads, and the thread that called
+	 * start() or render() use the time step of the audio output.
+	 */
+	static inline thread_local float dt = 1.0f / 48000.0f;
+
+	/**
+	 * @brief The maximum number of time steps processed in one block.
+	 */
+	static constexpr std::size_t max_block_size = 128;
+
+	/**
+	 * @brief The level below which decaying values are set to exactly zero.
+	 *
+	 * This is about -200 dB, far below anything audible, but well above the
+	 * range of denormal numbers, which are very slow to process on many CPUs.
+	 */
+	static constexpr float silence = 1e-10f;
+
+protected:
+	/**
+	 * @brief Run the modules nested in this module.
+	 *
+	 * Modules that contain other modules, like Oversampler, call this from
+	 * their process() function. The nested modules are run in the order
+	 * determined by their connections, with the current value of #dt.
+	 *
+	 * @param frames  The number of time steps to process, at most #max_block_size.
+	 */
+	void run_children(std::size_t frames);
+
+	/**
+	 * @brief Let this module run another module.
+	 *
+	 * The other module is no longer run by the audio thread itself, instead
+	 * this module has to run it, either using run_children() or by calling
+	 * its process() function directly.
+	 *
+	 * @param child  The module to run.
+	 * @param scale  The factor #dt is multiplied with while this module runs it.
+	 * @throw std::invalid_argument if @p child is a Parameter and @p scale is not 1.
+	 */
+	void contain(Module &child, float scale = 1);
+
+private:
+	friend struct Profiler;
+	friend struct Registry;
+	friend struct Changes;
+
+	bool disabled{};            ///< Whether this module was disabled using Changes, set by the audio thread.
+	const Module *controller{}; ///< The module this module sleeps with while it is idle, set by the audio thread.
+	const std::vector<Module *> *children{}; ///< The modules nested in this module, in the order they must be run, set by the audio thread.
+
+	/// The time spent running this module, only updated while profiling is enabled.
+	struct Counters {
+		std::atomic<std::uint64_t> calls{};    ///< The number of times process() was called.
+		std::atomic<std::uint64_t> time{};     ///< The total time spent in process(), in nanoseconds.
+		std::atomic<std::uint64_t> max_time{}; ///< The longest time spent in a single call, in nanoseconds.
+	} counters;
+};
+
+/**
+ * @brief An output signal of a module.
+ *
+ * This holds the values generated by a module for every time step of the
+ * current block. When modules are run one time step at a time, the current
+ * value is always the first element of the buffer, and an Output can be read
+ * and written as if it was a float.
+ *
+ * An output belongs to the module it is a member of. This is used to determine
+ * the order in which modules are run, so that a module is run after all the
+ * modules it has inputs connected to. Inputs and outputs must therefore be
+ * declared as members of a Module, and before any member modules.
+ */
+struct Output {
+	float buffer[Module::max_block_size]; ///< The values for each time step of the current block.
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param initial  The initial value of the output.
+	 */
+	Output(float initial = 0);
+
+	Output(const Output &other) = delete;
+
+	/**
+	 * @brief The destructor.
+	 *
+	 * Inputs connected to this output are disconnected. This matters for
+	 * outputs that are not stored inside their module, like the elements of a
+	 * std::vector, which are destroyed before the module is removed.
+	 */
+	~Output();
+
+	float &operator[](std::size_t i) { return buffer[i]; }       ///< Access the value at time step @p i.
+	float operator[](std::size_t i) const { return buffer[i]; }  ///< Read the value at time step @p i.
+	operator float() const { return buffer[0]; }                ///< Read the current value.
+
+	/// Set the current value.
+	Output &operator=(float value)
+	{
+		buffer[0] = value;
+		return *this;
+	}
+
+	/**
+	 * @brief Check whether this output is read by another module.
+	 *
+	 * This is true if an Input is connected to this output, or a Wire reads
+	 * from it. Modules can use this to skip computing outputs nobody reads.
+	 * Modules that read outputs directly from their update() function are not
+	 * known to the registry.
+	 */
+	bool connected() const { return used; }
+
+private:
+	friend struct Registry;
+	Module *owner;          ///< The module this output belongs to.
+	mutable bool used{};    ///< Whether this output is read by another module, set by the audio thread.
+};
+
+/**
+ * @brief An input signal of a module.
+ *
+ * An input is either set to a constant value by assigning a float to it, or it
+ * is connected to an Output, in which case it directly reads from the buffer
+ * of that Output. A connection therefore does not cost anything while the
+ * audio is being generated.
+ *
+ * If connections form a feedback loop, one of the inputs in the loop will read
+ * the values its output had in the previous block. Modules are normally run in
+ * blocks of #Module::max_block_size time steps, so this delays the loop by that
+ * many time steps. Only when modules are run one time step at a time, because
+ * one of them does not implement Module::process(), is this a delay of exactly
+ * one time step.
+ */
+struct Input {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param value  The initial value of the input.
+	 */
+	Input(float value = 0);
+
+	Input(const Input &other) = delete;
+
+	~Input();
+
+	/// Read the value at time step @p i.
+	float operator[](std::size_t i) const
+	{
+		return buffer ? buffer[i] : value;
+	}
+
+	/// Read the current value.
+	operator float() const
+	{
+		return (*this)[0];
+	}
+
+	/**
+	 * @brief Set the input to a constant value.
+	 *
+	 * This never blocks, so it can be called from within a module's process()
+	 * function. If the input is connected, it keeps reading from its output
+	 * until it is disconnected by the next call to the global commit()
+	 * function.
+	 */
+	Input &operator=(float value)
+	{
+		this->value = value;
+
+		if (source) {
+			detach.store(true, std::memory_order_relaxed);
+		}
+
+		return *this;
+	}
+
+	/**
+	 * @brief Connect this input to an output.
+	 *
+	 * If the audio output is active, this only takes effect after calling the
+	 * global commit() function.
+	 *
+	 * @param output  The output to read values from.
+	 */
+	void connect(const Output &output);
+
+	/// Disconnect this input, it will keep the last constant value assigned to it after the next commit().
+	void disconnect();
+
+	/// Check whether this input is connected to an output.
+	bool connected() const
+	{
+		return source;
+	}
+
+	/**
+	 * @brief Check whether this input has the same value for every time step of the current block.
+	 *
+	 * This is true if the input is not connected, or is driven by a Parameter
+	 * that is not changing during this block. Modules can use this to compute
+	 * values derived from the input only once per block.
+	 */
+	bool constant() const
+	{
+		return !buffer;
+	}
+
+private:
+	friend struct Registry;
+	friend struct Parameter;
+	friend struct Changes;
+	float value;            ///< The constant value of this input.
+	const Output *source{}; ///< The output this input is connected to.
+	const float *buffer{};  ///< The buffer values are read from, normally that of #source.
+	Module *owner;          ///< The module this input belongs to.
+	std::atomic<bool> detach{}; ///< Whether to disconnect this input at the next commit().
+};
+
+/**
+ * @brief A coefficient derived from a parameter.
+ *
+ * Many modules derive a per time step coefficient from a parameter using an
+ * expensive function, like std::exp2(). Since parameters change rarely, this
+ * remembers the last parameter and coefficient, and only calls the function
+ * again when the parameter has changed.
+ */
+struct Coefficient {
+	/**
+	 * @brief Get the coefficient for a given parameter.
+	 *
+	 * @param parameter  The current value of the parameter.
+	 * @param function   The function that derives the coefficient from the parameter.
+	 * @return           The coefficient, exactly as returned by @p function.
 	 */
-	static constexpr float dt = 1.0f / 48000.0f;
+	template<typename Function>
+	float operator()(float parameter, Function function)
+	{
+		if (parameter != this->parameter || Module::dt != dt) {
+			this->parameter = parameter;
+			dt = Module::dt;
+			value = function(parameter);
+		}
+
+		return value;
+	}
+
+private:
+	float parameter{std::numeric_limits<float>::quiet_NaN()}; ///< The parameter the coefficient was derived from.
+	float dt{};                                               ///< The time step the coefficient was derived for.
+	float value{};                                            ///< The coefficient.
 };
 
 /**
@@ -65,32 +420,55 @@ struct Module {
  * determined by the frequency input value. Several waveforms are derived that
  * are made available as outputs.
  *
+ * In #BAND_LIMITED mode, the discontinuities in the sawtooth, square and
+ * triangle waveforms are smoothed using [PolyBLEP] and PolyBLAMP residuals,
+ * which greatly reduces aliasing at high frequencies, and the sine is
+ * calculated using a polynomial approximation. In this mode, only the outputs
+ * that are connected to an Input or read by a Wire are computed.
+ *
  * [numerically controlled oscillator]: https://en.wikipedia.org/wiki/Numerically-controlled_oscillator
+ * [PolyBLEP]: https://www.martin-finke.de/articles/audio-plugins-018-polyblep-oscillator/
  */
 struct VCO: Module {
+	/// The way the waveforms are generated.
+	enum Mode {
+		NAIVE,        ///< All waveforms are computed exactly, and have sharp edges.
+		BAND_LIMITED, ///< Only connected waveforms are computed, with reduced aliasing.
+	};
+
 	/// @name Inputs
 	///@{
-	float frequency{}; ///< The frequency of the oscillator, in Hz.
+	Input frequency; ///< The frequency of the oscillator, in Hz.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float sawtooth_out{-1}; ///< Sawtooth (ramp) output.
-	float sine_out{};       ///< Sine wave output.
-	float square_out{1};    ///< Square wave output.
-	float triangle_out{};   ///< Triangular wave output.
+	Output sawtooth_out{-1}; ///< Sawtooth (ramp) output.
+	Output sine_out;         ///< Sine wave output.
+	Output square_out{1};    ///< Square wave output.
+	Output triangle_out;     ///< Triangular wave output.
 	///@}
 
+	Mode mode{NAIVE}; ///< The way the waveforms are generated.
+
 	VCO() = default;
 
 	/**
 	 * @brief The constructor.
 	 *
 	 * @param frequency  The initial frequency to oscillate at, in Hz.
+	 * @param mode       The way the waveforms are generated.
 	 */
-	VCO(float frequency): frequency(frequency) {}
+	VCO(float frequency, Mode mode = NAIVE): frequency(frequency), mode(mode) {}
 
-	void update(); ///< The function that will update the state of this module.
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	void process_band_limited(std::size_t frames);
+
+	// Internal state
+	float phase{}; ///< The current phase, between 0 and 1.
 };
 
 /**
@@ -102,22 +480,23 @@ struct VCO: Module {
  * the attack, the decay phase will decrease #amplitude_out exponentially,
  * halving it once every #decay seconds. The #gate_in going low (<= 0) triggers
  * the release phase, which will decrease #amplitude_out exponentially, halving
- * it once every #release seconds.
+ * it once every #release seconds. Once the amplitude drops below
+ * Module::silence, it is set to exactly zero.
  *
  * [envelope generator]: https://en.wikipedia.org/wiki/Envelope_(music)
  */
 struct Envelope: Module {
 	/// @name Inputs
 	///@{
-	float gate_in{}; ///< Gate input, > 0 trigger attack, <= 0 triggers release.
-	float attack{};  ///< The attack rise time in seconds.
-	float decay{};   ///< The decay time in seconds.
-	float release{}; ///< The release time in seconds.
+	Input gate_in; ///< Gate input, > 0 trigger attack, <= 0 triggers release.
+	Input attack;  ///< The attack rise time in seconds.
+	Input decay;   ///< The decay time in seconds.
+	Input release; ///< The release time in seconds.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float amplitude_out{}; ///< The generated amplitude.
+	Output amplitude_out; ///< The generated amplitude.
 	///@}
 
 	Envelope() = default;
@@ -131,7 +510,20 @@ struct Envelope: Module {
 	 */
 	Envelope(float attack, float decay, float release): attack(attack), decay(decay), release(release) {}
 
-	void update(); ///< The function that will update the state of this module.
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+	/**
+	 * @brief Whether the envelope is idle.
+	 *
+	 * The envelope is idle when it is in the release phase, and #amplitude_out
+	 * has been exactly zero during the last two blocks. Modules reading from
+	 * #amplitude_out have then had at least one full block to become silent
+	 * themselves.
+	 *
+	 * @return True if the envelope is idle.
+	 */
+	bool idle() const override { return state == RELEASE && silent_blocks >= 2; }
 
 private:
 	// Internal state
@@ -139,7 +531,12 @@ private:
 		ATTACK,
 		DECAY,
 		RELEASE,
-	} state; ///< The phase in which the envelope generator currectly is.
+	} state{RELEASE}; ///< The phase in which the envelope generator currectly is.
+	float amplitude{}; ///< The current amplitude.
+	int silent_blocks{2}; ///< The number of consecutive blocks the amplitude was zero, up to two.
+	Coefficient attack_step;    ///< The increase in amplitude per time step during the attack.
+	Coefficient decay_factor;   ///< The decrease in amplitude per time step during the decay.
+	Coefficient release_factor; ///< The decrease in amplitude per time step during the release.
 };
 
 // Modifiers
@@ -155,13 +552,13 @@ private:
 struct VCA: Module {
 	/// @name Inputs
 	///@{
-	float audio_in{};  ///< The audio input signal.
-	float amplitude{}; ///< The amplitude to multiply the input with.
+	Input audio_in;  ///< The audio input signal.
+	Input amplitude; ///< The amplitude to multiply the input with.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float audio_out{}; ///< The amplified audio output signal.
+	Output audio_out; ///< The amplified audio output signal.
 	///@}
 
 	VCA() = default;
@@ -173,7 +570,8 @@ struct VCA: Module {
 	 */
 	VCA(float amplitude): amplitude(amplitude) {}
 
-	void update(); ///< The function that will update the state of this module.
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
 };
 
 /**
@@ -182,22 +580,24 @@ struct VCA: Module {
  * This is a 12 dB/octave [state variable filter]. It will filter #audio_in
  * according to the given #cutoff frequency and #resonance level, and will
  * provide lowpass, bandpass and highpass filtered versions of the input.
+ * When the filter has rung out below Module::silence, its state is set to
+ * exactly zero.
  *
  * [state variable filter]: https://en.wikipedia.org/wiki/State_variable_filter
  */
 struct VCF: Module {
 	/// @name Inputs
 	///@{
-	float audio_in{}; ///< The audio input signal.
-	float cutoff{}; ///< The cutoff frequency in Hz.
-	float resonance{}; ///< The resonance, 0 for no resonance, higher values produce more resonance.
+	Input audio_in;  ///< The audio input signal.
+	Input cutoff;    ///< The cutoff frequency in Hz.
+	Input resonance; ///< The resonance, 0 for no resonance, higher values produce more resonance.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float lowpass_out{}; ///< A lowpass filtered version of #audio_in.
-	float bandpass_out{}; ///< A bandpass filtered version of #audio_in.
-	float highpass_out{}; ///< A highpass filtered version of #audio_in.
+	Output lowpass_out;  ///< A lowpass filtered version of #audio_in.
+	Output bandpass_out; ///< A bandpass filtered version of #audio_in.
+	Output highpass_out; ///< A highpass filtered version of #audio_in.
 	///@}
 
 	VCF() = default;
@@ -209,7 +609,13 @@ struct VCF: Module {
 	 * @param resonance  The initial resonance level to initialize the filter with.
 	 */
 	VCF(float cutoff, float resonance): cutoff(cutoff), resonance(resonance) {}
-	void update(); ///< The function that will update the state of this module.
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	// Internal state
+	float lowpass{};  ///< The current lowpass filter state.
+	float bandpass{}; ///< The current bandpass filter state.
 };
 
 /**
@@ -220,13 +626,13 @@ struct VCF: Module {
 struct LinearSlew: Module {
 	/// @name Inputs
 	///@{
-	float in{}; ///< The input signal.
-	float rate{1}; ///< The slew rate in units/second.
+	Input in;      ///< The input signal.
+	Input rate{1}; ///< The slew rate in units/second.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float out{}; ///< The output signal.
+	Output out; ///< The output signal.
 	///@}
 
 	LinearSlew() = default;
@@ -237,9 +643,14 @@ struct LinearSlew: Module {
 	 * @param rate     The slew rate in units/second.
 	 * @param initial  The initial value of the output.
 	 */
-	LinearSlew(float rate = 1, float initial = 0): rate(rate), out(initial) {}
+	LinearSlew(float rate = 1, float initial = 0): rate(rate), out(initial), value(initial) {}
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
 
-	void update(); ///< The function that will update the state of this module.
+private:
+	// Internal state
+	float value; ///< The current output value.
 };
 
 /**
@@ -250,13 +661,13 @@ struct LinearSlew: Module {
 struct ExponentialSlew: Module {
 	/// @name Inputs
 	///@{
-	float in{1};    ///< The input signal.
-	float rate{1}; ///< The slew rate in octaves/second.
+	Input in{1};   ///< The input signal.
+	Input rate{1}; ///< The slew rate in octaves/second.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float out{1}; ///< The output signal.
+	Output out{1}; ///< The output signal.
 	///@}
 
 	ExponentialSlew() = default;
@@ -267,9 +678,52 @@ struct ExponentialSlew: Module {
 	 * @param rate     The slew rate in octaves/second.
 	 * @param initial  The initial value of the output.
 	 */
-	ExponentialSlew(float rate = 1, float initial = 1): rate(rate), out(initial) {}
+	ExponentialSlew(float rate = 1, float initial = 1): rate(rate), out(initial), value(initial) {}
 
-	void update(); ///< The function that will update the state of this module.
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	// Internal state
+	float value; ///< The current output value.
+	Coefficient max_factor; ///< The maximum change in the output per time step.
+};
+
+/**
+ * @brief The ways to read a signal between two time steps.
+ */
+enum class Interpolation {
+	NONE,    ///< Use the nearest time step.
+	LINEAR,  ///< Linear interpolation between the two nearest time steps.
+	CUBIC,   ///< Cubic Hermite (Catmull-Rom) interpolation using the four nearest time steps.
+	ALLPASS, ///< First order allpass interpolation, which does not attenuate high frequencies.
+};
+
+/**
+ * @brief The history of a signal, stored in a circular buffer.
+ *
+ * This is the building block of delays. The buffer is allocated once, with a
+ * power of two size, so it never has to move any values. A whole block is
+ * written at once, after which any number of taps can read from it.
+ */
+struct DelayLine {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param max_delay  The maximum delay in seconds.
+	 */
+	DelayLine(float max_delay);
+
+	void write(const Input &in, std::size_t frames);
+	void read(const Input &delay, Output &out, std::size_t frames, Interpolation interpolation, float &state) const;
+	void prepare();
+
+private:
+	float max_delay;           ///< The maximum delay in seconds.
+	std::vector<float> buffer; ///< The circular buffer.
+	std::size_t mask;          ///< The size of the buffer minus one.
+	std::size_t position{};    ///< The index one past the most recently written value, modulo the size.
+	std::size_t max_samples;   ///< The maximum delay in time steps.
 };
 
 /**
@@ -281,29 +735,154 @@ struct ExponentialSlew: Module {
 struct Delay: Module {
 	/// @name Inputs
 	///@{
-	float in{};  ///< The input signal.
-	float delay; ///< The delay in seconds.
+	Input in;    ///< The input signal.
+	Input delay; ///< The delay in seconds.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float out{}; ///< The output signal.
+	Output out; ///< The output signal.
 	///@}
 
+	Interpolation interpolation; ///< How to read the input between time steps.
+
 	/**
 	 * @brief The constructor.
 	 *
-	 * @param max_delay  The maximum delay in seconds.
+	 * @param max_delay      The maximum delay in seconds.
+	 * @param interpolation  How to read the input between time steps.
 	 */
-	Delay(float max_delay = 1);
+	Delay(float max_delay = 1, Interpolation interpolation = Interpolation::LINEAR);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+	void prepare() override;
 
-	void update(); ///< The function that will update the state of this module.
 private:
-	std::deque<float> buffer;
+	DelayLine line;   ///< The history of the input.
+	float state{};    ///< The state of the allpass interpolator.
+};
+
+/**
+ * @brief A delay with multiple taps.
+ *
+ * This provides several outputs, each of which is the input delayed by its
+ * own time, while storing the history of the input only once. This is useful
+ * for choruses and reverbs.
+ *
+ * After construction, the number of taps must not be changed.
+ */
+struct MultiTapDelay: Module {
+	/// @name Inputs
+	///@{
+	Input in;                 ///< The input signal.
+	std::vector<Input> delay; ///< The delay of each tap in seconds.
+	///@}
+
+	/// @name Outputs
+	///@{
+	std::vector<Output> out; ///< The output signal of each tap.
+	///@}
+
+	Interpolation interpolation; ///< How to read the input between time steps.
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param taps           The number of taps.
+	 * @param max_delay      The maximum delay in seconds.
+	 * @param interpolation  How to read the input between time steps.
+	 */
+	MultiTapDelay(std::size_t taps, float max_delay = 1, Interpolation interpolation = Interpolation::LINEAR);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+	void prepare() override;
+
+private:
+	DelayLine line;           ///< The history of the input.
+	std::vector<float> state; ///< The state of the allpass interpolator of each tap.
 };
 
 // Sequencer
 
+/**
+ * @brief Get the frequency of a note.
+ *
+ * A note is written as a letter from A to G, optionally followed by `#` or
+ * `b`, followed by the octave, for example `C4` or `Bb1`. The A in octave 4 is
+ * 440 Hz. This can be evaluated at compile time, so tables of notes cost
+ * nothing at run time.
+ *
+ * @param note  The name of the note.
+ * @return      The frequency of the note in Hz.
+ */
+constexpr float note_frequency(std::string_view note)
+{
+	constexpr double ratios[12] = {
+		1.0, 1.0594630943592953, 1.122462048309373, 1.189207115002721,
+		1.2599210498948732, 1.3348398541700344, 1.4142135623730951, 1.4983070768766815,
+		1.5874010519681994, 1.681792830507429, 1.7817974362806785, 1.8877486253633868,
+	};
+	constexpr int letters[7] = {9, 11, 0, 2, 4, 5, 7};
+
+	if (note.empty() || note[0] < 'A' || note[0] > 'G') {
+		throw std::invalid_argument("invalid note");
+	}
+
+	int semitone = letters[note[0] - 'A'];
+	std::size_t pos = 1;
+
+	if (pos < note.size() && (note[pos] == '#' || note[pos] == 'b')) {
+		semitone += note[pos++] == '#' ? 1 : -1;
+	}
+
+	if (pos == note.size() || note.size() - pos > 2) {
+		throw std::invalid_argument("invalid note");
+	}
+
+	int octave = 0;
+
+	for (; pos < note.size(); pos++) {
+		if (note[pos] < '0' || note[pos] > '9') {
+			throw std::invalid_argument("invalid note");
+		}
+
+		octave = octave * 10 + (note[pos] - '0');
+	}
+
+	// Split the distance to A4 in semitones into whole octaves and the rest
+	int distance = semitone - 9 + 12 * (octave - 4);
+	int octaves = (distance + 120) / 12 - 10;
+	double frequency = 440 * ratios[distance - 12 * octaves];
+
+	for (; octaves > 0; octaves--) {
+		frequency *= 2;
+	}
+
+	for (; octaves < 0; octaves++) {
+		frequency /= 2;
+	}
+
+	return frequency;
+}
+
+/**
+ * @brief Get the frequencies of a list of notes.
+ *
+ * This makes it easy to build patterns at compile time:
+ *
+ *     static constexpr auto bass = note_frequencies("C2", "D2", "Bb1", "F1");
+ *
+ * @param notes  The names of the notes, see note_frequency().
+ * @return       The frequencies of the notes in Hz.
+ */
+template<typename... Notes>
+constexpr std::array<float, sizeof...(Notes)> note_frequencies(Notes... notes)
+{
+	return {note_frequency(notes)...};
+}
+
 /**
  * @brief A simple sequencer.
  *
@@ -316,22 +895,33 @@ private:
  * become 0 when #clock_in goes low (<= 0), thus providing a clean version of
  * the #clock_in.
  *
+ * If #tempo is set to a value above zero, #clock_in is ignored, and the
+ * sequencer advances by itself at exactly that number of steps per minute,
+ * counted in time steps, so the timing is the same whether audio is rendered
+ * or played live. The #gate_out is then high during the first #gate_length of
+ * every step. Both are read once per block, and the outputs are written in
+ * spans during which they are constant. Steps are at least one time step
+ * long, however high the tempo is.
+ *
  * After construction, the size of the vector #frequencies must not be changed,
- * but the frequencies can be modified.
+ * but the frequencies can be modified. To play a different number of notes,
+ * use play() to switch to another pattern.
  *
  * [sequencer]: https://en.wikipedia.org/wiki/Analog_sequencer
  */
 struct Sequencer: Module {
 	/// @name Inputs
 	///@{
-	float clock_in{};               ///< The clock input.
+	Input clock_in;                 ///< The clock input.
+	Input tempo;                    ///< The number of steps per minute, or zero to advance on #clock_in.
+	Input gate_length{0.5f};        ///< The fraction of each step #gate_out is high when using #tempo.
 	std::vector<float> frequencies; ///< The list of frequencies the sequencer cycles through.
 	///@}
 
 	/// @name Outputs
 	///@{
-	float frequency_out; ///< The currently selected frequency.
-	float gate_out;      ///< A cleaned up copy of #clock_in.
+	Output frequency_out; ///< The currently selected frequency.
+	Output gate_out;      ///< A cleaned up copy of #clock_in.
 	///@}
 
 	/**
@@ -339,13 +929,69 @@ struct Sequencer: Module {
 	 *
 	 * @param notes  The initial list of notes used to initialize the list of frequencies.
 	 */
-	Sequencer(std::initializer_list<std::string> notes);
+	Sequencer(std::initializer_list<std::string> notes): Sequencer(std::vector<std::string>(notes)) {}
+	Sequencer(const std::vector<std::string> &notes); ///< @copydoc Sequencer(std::initializer_list<std::string>)
 
-	void update(); ///< The function that will update the state of this module.
+	/**
+	 * @brief Construct a sequencer from a pattern of frequencies.
+	 *
+	 * @param pattern  The frequencies, for example built by note_frequencies().
+	 */
+	template<std::size_t N>
+	Sequencer(const std::array<float, N> &pattern): frequencies(pattern.begin(), pattern.end())
+	{
+		static_assert(N > 0, "a pattern needs at least one note");
+		index = N - 1;
+	}
+
+	/**
+	 * @brief Switch to another pattern.
+	 *
+	 * The first frequency of the @p pattern is played at the next step. The
+	 * pattern is not copied and no memory is allocated, so this can be called
+	 * from any control thread while the audio output is active. The pattern
+	 * must stay valid as long as the sequencer might play it, which is easiest
+	 * with patterns that are `static constexpr`. Calling play() with
+	 * #frequencies switches back to the sequencer's own list.
+	 *
+	 * @param pattern  A pointer to the frequencies.
+	 * @param steps    The number of frequencies in the pattern, at least one.
+	 * @return         Whether the switch could be queued.
+	 */
+	bool play(const float *pattern, std::size_t steps);
+
+	/// @copydoc play(const float *, std::size_t)
+	template<std::size_t N>
+	bool play(const std::array<float, N> &pattern)
+	{
+		static_assert(N > 0, "a pattern needs at least one note");
+		return play(pattern.data(), N);
+	}
+
+	/// @copydoc play(const float *, std::size_t)
+	bool play(const std::vector<float> &pattern)
+	{
+		return play(pattern.data(), pattern.size());
+	}
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
 
 private:
+	/// A pattern of frequencies that is not owned by the sequencer.
+	struct Pattern {
+		const float *frequencies; ///< The frequencies.
+		std::size_t steps;        ///< The number of frequencies.
+	};
+
+	void advance();
+
 	// Internal state
-	std::size_t index; ///< The index of the currently selected frequency.
+	std::size_t index;          ///< The index of the currently selected frequency.
+	bool gate{};                ///< Whether the clock input was high during the previous time step.
+	Pattern pattern{};          ///< The pattern being played, or none to play #frequencies.
+	double until_step{};        ///< The number of time steps until the next step when using #tempo.
+	MPSCQueue<Pattern, 4> next; ///< Patterns to switch to at the next step.
 };
 
 
@@ -354,22 +1000,65 @@ private:
  *
  * A speaker will ensure the input signals are sent to the audio card. Multiple
  * speaker objects can be used, and the input of all of them will be mixed
- * together.
+ * together. Every thread mixes into its own copy of the output bus, so
+ * speakers can run in parallel.
  */
 struct Speaker: Module {
 	/// @name Inputs
 	///@{
-	float left_in{};  ///< The left channel audio input.
-	float right_in{}; ///< The right channel audio input.
+	Input left_in;  ///< The left channel audio input.
+	Input right_in; ///< The right channel audio input.
+	///@}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param channel  The output channel the left input is sent to, the right input is sent to the next one.
+	 */
+	Speaker(std::size_t channel = 0): channel(channel) {}
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	std::size_t channel; ///< The output channel of the left input.
+};
+
+/**
+ * @brief A speaker with any number of channels.
+ *
+ * This sends each input to consecutive channels of the audio output, for
+ * setups with more than two speakers. Inputs for channels the audio output
+ * does not have are ignored.
+ */
+struct MultichannelSpeaker: Module {
+	/// @name Inputs
+	///@{
+	std::vector<Input> in; ///< The audio input of each channel.
 	///@}
 
-	void update(); ///< The function that will update the state of this module.
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param channels  The number of inputs.
+	 * @param first     The output channel the first input is sent to.
+	 */
+	MultichannelSpeaker(std::size_t channels, std::size_t first = 0);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	std::size_t first; ///< The output channel of the first input.
 };
 
 /**
  * @brief A wire connecting an output value to an input value.
  *
- * This is a module that will automatically copy the given output value to the input value.
+ * This is a module that will automatically copy the given output value to the
+ * input value. A wire from an Output to an Input just connects them, and takes
+ * no part in generating audio. A wire to a plain float copies one time step at
+ * a time.
  */
 struct Wire: Module {
 	/**
@@ -378,25 +1067,594 @@ struct Wire: Module {
 	 * @param from  A reference to the value to copy from.
 	 * @param to    A reference to the value to copy to.
 	 */
-	Wire(const float &from, float &to): from(from), to(to) {}
-	void update();     ///< The function that copies from one value to the other.
+	Wire(const float &from, float &to): from_value(&from), to_value(&to) {}
+	Wire(const float &from, Input &to);                                       ///< @copydoc Wire(const float &, float &)
+	Wire(const Output &from, float &to);                                      ///< @copydoc Wire(const float &, float &)
+	Wire(const Output &from, Input &to);                                      ///< @copydoc Wire(const float &, float &)
+
+	void process(std::size_t frames) override; ///< The function that copies from one value to the other.
+	bool block_processing() const override;
+
 private:
-	const float &from; ///< A reference to the value to copy from.
-	float &to;         ///< A reference to the value to copy to.
+	const float *from_value{};   ///< A pointer to the value to copy from.
+	const Output *from_output{}; ///< A pointer to the output to copy from.
+	float *to_value{};           ///< A pointer to the value to copy to.
+	Input *to_input{};           ///< A pointer to the input to copy to.
 };
 
+/**
+ * @brief A container that runs modules at a higher sample rate.
+ *
+ * Nonlinear modules and filters with a high cutoff frequency generate or
+ * respond to frequencies above the Nyquist frequency, which then alias back
+ * into the audible range. An Oversampler runs the modules nested in it at 2, 4
+ * or 8 times the sample rate of the audio output, while all other modules keep
+ * running at the normal rate. Its inputs are upsampled and made available to
+ * the nested modules via #inner_in, and the outputs of the nested modules
+ * connected to #inner_out are downsampled again to #out, using cascaded
+ * polyphase half-band filters.
+ *
+ * Nested modules see a correspondingly smaller Module::dt. They must
+ * implement process(), should only be connected to the Oversampler and to
+ * each other, and must not be Speakers. The filters delay the signal by 16
+ * time steps when oversampling 2 times, 24 when oversampling 4 times, and 28
+ * when oversampling 8 times.
+ */
+struct Oversampler: Module {
+	/// @name Inputs
+	///@{
+	std::vector<Input> in;        ///< The signals to upsample.
+	std::vector<Input> inner_out; ///< The outputs of the nested modules to downsample.
+	///@}
+
+	/// @name Outputs
+	///@{
+	std::vector<Output> inner_in; ///< The upsampled input signals, to be read by the nested modules.
+	std::vector<Output> out;      ///< The downsampled output signals.
+	///@}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param factor   The oversampling factor, either 2, 4 or 8.
+	 * @param inputs   The number of signals to upsample.
+	 * @param outputs  The number of signals to downsample.
+	 * @param modules  The modules to run at the higher sample rate.
+	 */
+	Oversampler(std::size_t factor, std::size_t inputs, std::size_t outputs, std::initializer_list<Module *> modules);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	/**
+	 * A half-band lowpass filter that doubles or halves the sample rate.
+	 *
+	 * Apart from the center one, only every other coefficient of a half-band
+	 * filter is nonzero, so the signal at the higher rate is split into an
+	 * even and an odd phase, and only the odd phase is actually filtered.
+	 */
+	struct HalfBand {
+		static constexpr std::size_t taps = 8; ///< The number of nonzero coefficients on each side of the center.
+		static const std::array<float, 2 * taps> coefficients; ///< The coefficients of the odd phase, summing to one.
+
+		float even[2 * taps]{}; ///< The most recent values at the lower rate, or of the even phase.
+		float odd[2 * taps]{};  ///< The most recent values of the odd phase.
+
+		void upsample(const float *in, float *out, std::size_t frames);
+		void downsample(const float *in, float *out, std::size_t frames);
+	};
+
+	std::size_t factor;         ///< The oversampling factor.
+	std::size_t stages;         ///< The number of half-band filters needed for the oversampling factor.
+	std::vector<HalfBand> up;   ///< The filters of each input, one for every stage.
+	std::vector<HalfBand> down; ///< The filters of each output, one for every stage.
+};
+
+/**
+ * @brief A container that runs modules at a lower sample rate.
+ *
+ * Modulation sources like LFOs, envelopes and slew limiters produce signals
+ * that change slowly compared to the sample rate of the audio output. A
+ * ControlRate container runs the modules nested in it only once every
+ * #factor time steps, which divides the time spent in them by that factor.
+ * Its inputs are sampled at the start of every control step and made
+ * available to the nested modules via #inner_in. The outputs of the nested
+ * modules connected to #inner_out are interpolated linearly back to the
+ * sample rate of the audio output at #out, so audio rate modules reading them
+ * do not cause zipper noise.
+ *
+ * Nested modules see a correspondingly larger Module::dt, should only be
+ * connected to the ControlRate container and to each other, and must not be
+ * Speakers. The inputs are not filtered before they are sampled, so they
+ * should only carry slowly changing signals. The interpolation delays the
+ * outputs by #factor minus one time steps.
+ */
+struct ControlRate: Module {
+	/// @name Inputs
+	///@{
+	std::vector<Input> in;        ///< The signals to sample at the control rate.
+	std::vector<Input> inner_out; ///< The outputs of the nested modules to interpolate.
+	///@}
+
+	/// @name Outputs
+	///@{
+	std::vector<Output> inner_in; ///< The sampled input signals, to be read by the nested modules.
+	std::vector<Output> out;      ///< The interpolated output signals.
+	///@}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param factor   The number of time steps per control step, between 2 and Module::max_block_size.
+	 * @param inputs   The number of signals to sample.
+	 * @param outputs  The number of signals to interpolate.
+	 * @param modules  The modules to run at the control rate.
+	 */
+	ControlRate(std::size_t factor, std::size_t inputs, std::size_t outputs, std::initializer_list<Module *> modules);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	std::size_t factor;        ///< The number of time steps per control step.
+	std::size_t position{};    ///< The number of time steps of the current control step that have been output.
+	std::vector<float> from;   ///< The value of each output at the start of the current control step.
+	std::vector<float> to;     ///< The value of each output at the end of the current control step.
+};
+
+/**
+ * @brief A parameter that is automated from a control thread.
+ *
+ * This drives an input of another module, which must not be connected to an
+ * output. Control threads schedule changes at a given time with set(), which
+ * are applied at exactly the right time step, and either jump to the new value
+ * or ramp towards it linearly. During blocks in which the value does not change,
+ * the input is constant, so modules reading from it can take a faster path.
+ *
+ * This avoids having to write to inputs from an update() function every time
+ * step just to keep their values current, and the zipper noise that results
+ * from writing to them less often.
+ *
+ * Changes are timed in time steps of the audio output, so a parameter cannot
+ * be nested in a container that runs at a different rate, like Oversampler
+ * or ControlRate. Drive an input of the container instead.
+ */
+struct Parameter: Module {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param target  The input to drive.
+	 * @param value   The initial value.
+	 */
+	Parameter(Input &target, float value);
+
+	/**
+	 * @brief Schedule a change of the value.
+	 *
+	 * This can be called from any thread except the audio thread. Changes must
+	 * be scheduled in chronological order, and a change interrupts any ramp
+	 * still in progress.
+	 *
+	 * @param value  The new value.
+	 * @param ramp   The time in seconds it takes to ramp from the current to the new value, or 0 to jump.
+	 * @param time   The time the change should start, as returned by audio_time(), or 0 to start as soon as possible.
+	 * @return       True if the change was scheduled, false if too many changes are pending.
+	 */
+	bool set(float value, float ramp = 0, double time = 0);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	/// A change of the value.
+	struct Event {
+		double time; ///< The time the change starts.
+		float value; ///< The new value.
+		float ramp;  ///< The duration of the ramp.
+	};
+
+	static constexpr std::size_t queue_size = 64; ///< The maximum number of pending changes.
+
+	Input &target;                       ///< The input being driven.
+	float value;                         ///< The current value.
+	float step{};                        ///< The change of the value every time step during a ramp.
+	float end{};                         ///< The value at the end of the ramp.
+	std::size_t steps{};                 ///< The number of time steps left in the ramp.
+	float buffer[max_block_size];        ///< The values of a block that is not constant.
+	Event next{};                        ///< The next change, if #waiting.
+	std::uint64_t next_frame{};          ///< The time step the next change starts at.
+	bool waiting{};                      ///< Whether #next has been received but not started yet.
+	MPSCQueue<Event, queue_size> events; ///< Changes passed to the audio thread.
+};
+
+/**
+ * @brief A module that reports the level of a signal to a control thread.
+ *
+ * The peak and RMS level of the input are measured over consecutive intervals,
+ * and passed to a control thread through a lock-free queue, so meters in a GUI
+ * or levels sent over the network do not need to read any variables that the
+ * audio thread writes to. The input can be any signal, so this can also report
+ * the state of modules, like the amplitude of an Envelope.
+ */
+struct Meter: Module {
+	/// @name Inputs
+	///@{
+	Input in; ///< The signal to measure.
+	///@}
+
+	/// The level of the input during one interval.
+	struct Level {
+		double time; ///< The audio time at the end of the interval.
+		float peak;  ///< The largest absolute value.
+		float rms;   ///< The root mean square of the values.
+	};
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param interval  The time in seconds between reported levels.
+	 */
+	explicit Meter(float interval = 0.05f);
+
+	/**
+	 * @brief Get the oldest level that has not been read yet.
+	 *
+	 * This must only be called by one control thread. If levels are not read,
+	 * the queue fills up and newer levels are dropped.
+	 *
+	 * @param[out] level  The level.
+	 * @return            True if a level was read, false if none was available.
+	 */
+	bool read(Level &level);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+	void prepare() override;
+
+private:
+	float interval;               ///< The time in seconds between reported levels.
+	std::size_t length{};         ///< The number of time steps per interval.
+	std::size_t count{};          ///< The number of time steps measured so far in this interval.
+	float peak{};                 ///< The peak level so far in this interval.
+	double sum{};                 ///< The sum of the squared values so far in this interval.
+	SPSCQueue<Level, 16> levels;  ///< Levels passed to the control thread.
+};
+
+/**
+ * @brief The ways to send audio to the sound card.
+ */
+enum class Backend {
+	SDL,      ///< The default SDL audio driver.
+	PIPEWIRE, ///< PipeWire, using SDL's PipeWire audio driver.
+	ALSA,     ///< ALSA directly, if support for it was compiled in.
+	JACK,     ///< The JACK Audio Connection Kit, if support for it was compiled in.
+	NONE,     ///< No sound card, audio is generated in real time and discarded.
+};
+
+/**
+ * @brief Settings for generating audio.
+ */
+struct Settings {
+	Backend backend{Backend::SDL}; ///< The way to send audio to the sound card.
+
+	/**
+	 * @brief The name of the device to open.
+	 *
+	 * For ALSA this is the PCM device name, for JACK this is the client name.
+	 * If empty, a default is used.
+	 */
+	std::string device;
+
+	/**
+	 * @brief The sample rate in Hz.
+	 *
+	 * This is ignored by JACK, which always uses the sample rate of the JACK
+	 * server. Module::dt is set to the inverse of the actual sample rate.
+	 */
+	float sample_rate{48000};
+
+	std::size_t channels{2}; ///< The number of output channels, render() always generates two.
+
+	/**
+	 * @brief The gain applied to the mix of all speakers.
+	 *
+	 * The default makes the output a bit softer, so a few speakers playing at
+	 * full scale do not immediately clip.
+	 */
+	float gain{0.1f};
+
+	/**
+	 * @brief The level the output is limited to.
+	 *
+	 * Peaks above this level after applying the gain are reduced instantly,
+	 * after which the gain recovers within about 50 ms. Set this to infinity
+	 * to disable the limiter.
+	 */
+	float limit{1};
+
+	/**
+	 * @brief The number of frames per period.
+	 *
+	 * Smaller periods give lower latency, but increase the chance of
+	 * underruns. This is ignored by JACK, which always uses the buffer size of
+	 * the JACK server.
+	 */
+	std::size_t period{128};
+
+	/**
+	 * @brief The number of worker threads.
+	 *
+	 * If this is non-zero, groups of modules that do not depend on each other
+	 * are run in parallel, using this number of threads in addition to the
+	 * audio thread. Modules shared by several groups, like a clock feeding
+	 * many voices, run before those groups. Modules from different groups must
+	 * then not access each other's variables directly. The threads are stopped
+	 * again by stop(). This has no effect if any module does not
+	 * natively process blocks.
+	 */
+	std::size_t threads{};
+};
 
 /**
  * @brief Start the audio output.
  *
  * This function should be called after all the Module objects have been
  * instantiated.
+ *
+ * @param settings  The settings to use for generating audio.
  */
-void start();
+void start(const Settings &settings = {});
 
 /**
- * @brief Stop the audio output.
+ * @brief Stop the audio output and the worker threads.
  */
 void stop();
 
+/**
+ * @brief A destination for rendered audio.
+ *
+ * The audio generated by render() is passed to a sink one block at a time.
+ */
+struct Sink {
+	virtual ~Sink() = default;
+
+	/**
+	 * @brief Consume rendered audio.
+	 *
+	 * @param samples  The interleaved left and right channel samples.
+	 * @param frames   The number of frames, each consisting of a left and right channel sample.
+	 */
+	virtual void write(const float *samples, std::size_t frames) = 0;
+};
+
+/**
+ * @brief Render audio without using the audio card.
+ *
+ * This runs the modules as fast as possible, and passes the generated audio to
+ * the given sink. The audio card is not opened, so this also works on
+ * computers without sound hardware. This function returns when all the audio
+ * has been rendered. It must not be called while the audio output is active.
+ *
+ * @param seconds   The amount of audio to render, in seconds.
+ * @param sink      The sink to pass the generated audio to.
+ * @param settings  The settings to use for generating audio.
+ */
+void render(float seconds, Sink &sink, const Settings &settings = {});
+
+/**
+ * @brief Get the current audio time.
+ *
+ * This is the amount of audio generated since the program started, and can be
+ * used to schedule Parameter changes at exact times. It only advances while
+ * audio is being generated.
+ *
+ * @return The time in seconds of the start of the block being generated.
+ */
+double audio_time();
+
+/**
+ * @brief A batch of changes to modules, applied by the audio thread at the start of a block.
+ *
+ * Control threads, like those of a GUI or a network protocol, must not write
+ * to inputs while the audio thread reads them. Instead, they collect changes in
+ * a batch and send() it. The audio thread applies all changes of a batch
+ * together at the start of the next block, in the order they were added,
+ * without locking or allocating memory. Any number of threads can send batches
+ * at the same time. A single batch can hold at most queue_size changes, since
+ * it has to fit in the queue as a whole.
+ *
+ * Connections are changed using Input::connect() and commit() instead, which
+ * also take effect between two blocks without the audio thread having to wait
+ * for a lock. Inputs and modules must not be destroyed while changes to them
+ * might still be pending.
+ */
+struct Changes {
+	/**
+	 * @brief Add a change of the constant value of an input.
+	 *
+	 * If the input is connected, the value is used once it is disconnected.
+	 *
+	 * @param input  The input.
+	 * @param value  The new value.
+	 * @return       This batch, so changes can be chained.
+	 * @throw std::length_error if the batch already holds queue_size changes.
+	 */
+	Changes &set(Input &input, float value);
+
+	/**
+	 * @brief Add enabling or disabling a module.
+	 *
+	 * A disabled module is skipped by the audio thread like a sleeping module,
+	 * so its outputs keep the values of the last block it was run.
+	 *
+	 * @param mod      The module.
+	 * @param enabled  Whether the module should be run.
+	 * @return         This batch, so changes can be chained.
+	 * @throw std::length_error if the batch already holds queue_size changes.
+	 */
+	Changes &enable(Module &mod, bool enabled = true);
+
+	/**
+	 * @brief Send the changes to the audio thread.
+	 *
+	 * This can be called from any thread except the audio thread. If the
+	 * changes were sent, the batch is cleared, so it can be reused without
+	 * allocating memory again.
+	 *
+	 * @return  True if the changes were sent, false if too many changes are pending and the batch was kept.
+	 */
+	bool send();
+
+	/// Get the number of changes in this batch.
+	std::size_t size() const
+	{
+		return changes.size();
+	}
+
+	static constexpr std::size_t queue_size = 1024; ///< The maximum number of pending changes of all batches, and so of a single batch.
+
+private:
+	friend void generate(float *const *outputs, std::size_t channels, std::size_t stride, std::size_t frames);
+
+	/// A single change.
+	struct Change {
+		Input *input;        ///< The input to set, if any.
+		Module *mod;         ///< The module to enable or disable, if any.
+		float value;         ///< The value of the input.
+		bool enabled;        ///< Whether to enable the module.
+		std::uint32_t count; ///< The number of changes in the batch, only set for the first one.
+	};
+
+	void add(const Change &change);
+	static void receive();
+
+	std::vector<Change> changes;                    ///< The changes in this batch.
+	static MPSCQueue<Change, queue_size> queue;     ///< Changes passed to the audio thread.
+};
+
+/**
+ * @brief Profiling statistics of a single module.
+ */
+struct ModuleProfile {
+	const Module *module;   ///< The module.
+	std::string type;       ///< The name of the type of the module.
+	std::uint64_t calls;    ///< The number of times the module was run.
+	std::uint64_t time;     ///< The total time spent running the module, in nanoseconds.
+	std::uint64_t max_time; ///< The longest time spent running the module once, in nanoseconds.
+};
+
+/**
+ * @brief Profiling statistics of all modules of the same type.
+ */
+struct TypeProfile {
+	std::string type;       ///< The name of the type.
+	std::size_t modules;    ///< The number of modules of this type.
+	std::uint64_t calls;    ///< The number of times modules of this type were run.
+	std::uint64_t time;     ///< The total time spent running modules of this type, in nanoseconds.
+	std::uint64_t max_time; ///< The longest time spent running a module of this type once, in nanoseconds.
+};
+
+/**
+ * @brief A snapshot of the profiling statistics.
+ *
+ * All counters are cumulative since profiling was first enabled, so the
+ * statistics of an interval can be derived from the difference between two
+ * snapshots. A callback is a single request for audio from the audio backend,
+ * and its deadline is the duration of the audio it has to generate.
+ */
+struct Profile {
+	static constexpr std::size_t buckets = 11; ///< The number of buckets in the #histogram.
+
+	std::uint64_t callbacks;       ///< The number of callbacks.
+	std::uint64_t frames;          ///< The number of frames generated by all callbacks.
+	std::uint64_t time;            ///< The total time spent in callbacks, in nanoseconds.
+	std::uint64_t max_time;        ///< The longest time spent in a single callback, in nanoseconds.
+	std::uint64_t deadline_misses; ///< The number of callbacks that took longer than their deadline.
+	std::uint64_t xruns;           ///< The number of underruns reported by the audio backend.
+
+	/**
+	 * @brief The callbacks binned by the fraction of their deadline they used.
+	 *
+	 * Bucket i counts the callbacks that took between i and i + 1 tenths of
+	 * their deadline, the last bucket counts the callbacks that missed their
+	 * deadline.
+	 */
+	std::uint64_t histogram[buckets];
+
+	std::vector<ModuleProfile> modules; ///< The statistics of each module, in order of registration.
+	std::vector<TypeProfile> types;     ///< The statistics per type of module, the most expensive first.
+};
+
+/**
+ * @brief Enable or disable profiling.
+ *
+ * While profiling is enabled, the time spent running each module and
+ * generating each block of audio is measured. This adds two clock reads per
+ * module per block. It can be changed at any time.
+ *
+ * @param enabled  Whether profiling should be enabled.
+ */
+void set_profiling(bool enabled);
+
+/**
+ * @brief Get the profiling statistics.
+ *
+ * This takes a snapshot of the statistics collected so far. It can be called
+ * from any thread except the audio thread, and never blocks the audio thread.
+ *
+ * @return The profiling statistics.
+ */
+Profile profile();
+
+/**
+ * @brief Let modules sleep while another module is idle.
+ *
+ * This is typically used to stop running all the modules of a voice while its
+ * envelope is idle. The modules are run after the @p controller, so they wake
+ * up in the same block it stops being idle, and the @p controller should not
+ * depend on them. While sleeping, the outputs of the modules keep the values
+ * of the last block they were run. Sleeping modules should therefore only be
+ * read by modules that sleep with them, or by modules that multiply them with
+ * the output of the @p controller. This takes effect after the next commit().
+ *
+ * @param controller  The module that determines whether the other modules sleep.
+ * @param modules     The modules that sleep while the @p controller is idle.
+ */
+void sleep_while_idle(const Module &controller, std::initializer_list<Module *> modules);
+
+/**
+ * @brief Apply changes to modules and connections.
+ *
+ * Modules constructed and connections made while the audio output is active
+ * only take effect after calling this function. This compiles a new schedule
+ * and hands it over to the audio thread, which starts using it at the next
+ * block without ever blocking.
+ */
+void commit();
+
+/// @cond
+void remove(void *object, std::size_t size, void (*destroy)(void *));
+/// @endcond
+
+/**
+ * @brief Remove modules while the audio output is active.
+ *
+ * All modules that are part of @p object are removed immediately, and inputs
+ * of other modules connected to them are disconnected. The object itself is
+ * destroyed by a later call to commit(), remove() or stop(), once the audio
+ * thread is guaranteed to no longer use them. The object can be a single
+ * module, or any object containing modules, like a voice consisting of
+ * several modules. The type @p T must be the complete type of the object.
+ *
+ * @param object  The object to remove.
+ */
+template<typename T>
+void remove(std::unique_ptr<T> object)
+{
+	remove(object.release(), sizeof(T), [](void *ptr) {
+		delete static_cast<T *>(ptr);
+	});
+}
+
 }
@@ -0,0 +1,835 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "patch.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_set>
+
+#include "registry.hpp"
+
+namespace ModSynth
+{
+
+namespace
+{
+
+/**
+ * A port of a module type.
+ *
+ * Exactly one of #input and #output is set. They return the given element of
+ * the port of a module of that type, or nullptr if it has no such element.
+ */
+struct Port {
+	const char *name; ///< The name of the port.
+	bool vector;      ///< Whether the port is a vector of inputs or outputs.
+	Input *(*input)(Module &mod, std::size_t index);   ///< Get an element of an input port.
+	Output *(*output)(Module &mod, std::size_t index); ///< Get an element of an output port.
+};
+
+/**
+ * A module type that can be used in patches.
+ */
+struct Type {
+	const char *name;                                                    ///< The name of the type.
+	std::size_t size;                                                    ///< The size of a module of this type.
+	Module &(*create)(Arena &arena, const std::vector<std::string> &args); ///< Construct a module in an arena.
+	std::vector<Port> ports;                                             ///< The inputs and outputs.
+};
+
+/// Get an element of a port of a module of type @p T.
+template<typename T, auto member>
+auto element(Module &mod, std::size_t index)
+{
+	auto &port = static_cast<T &>(mod).*member;
+
+	if constexpr (std::is_same_v<std::remove_reference_t<decltype(port)>, std::vector<Input>> || std::is_same_v<std::remove_reference_t<decltype(port)>, std::vector<Output>>) {
+		return index < port.size() ? port.data() + index : nullptr;
+	} else {
+		return index ? nullptr : &port;
+	}
+}
+
+/// Describe the port @p member of type @p T.
+template<typename T, auto member>
+Port port(const char *name)
+{
+	using Member = std::remove_reference_t<decltype(std::declval<T &>().*member)>;
+
+	if constexpr (std::is_same_v<Member, Input> || std::is_same_v<Member, std::vector<Input>>) {
+		return {name, !std::is_same_v<Member, Input>, element<T, member>, nullptr};
+	} else {
+		return {name, !std::is_same_v<Member, Output>, nullptr, element<T, member>};
+	}
+}
+
+/**
+ * Parse a number.
+ *
+ * @param text  The text to parse.
+ * @return      The number.
+ */
+template<typename T>
+T parse_number(const std::string &text)
+{
+	T value{};
+	auto end = text.data() + text.size();
+	auto [ptr, ec] = std::from_chars(text.data(), end, value);
+
+	if (ec != std::errc() || ptr != end) {
+		throw std::invalid_argument("invalid number " + text);
+	}
+
+	return value;
+}
+
+/**
+ * Get a constructor argument.
+ *
+ * @param args      The arguments.
+ * @param i         The index of the argument.
+ * @param fallback  The value to use if there is no such argument.
+ * @return          The value of the argument.
+ */
+template<typename T>
+T arg(const std::vector<std::string> &args, std::size_t i, T fallback)
+{
+	return i < args.size() ? parse_number<T>(args[i]) : fallback;
+}
+
+/// Get an argument that is one of a list of names.
+template<typename T>
+T arg(const std::vector<std::string> &args, std::size_t i, T fallback, std::initializer_list<std::pair<const char *, T>> names)
+{
+	if (i >= args.size()) {
+		return fallback;
+	}
+
+	for (auto &[name, value] : names) {
+		if (args[i] == name) {
+			return value;
+		}
+	}
+
+	throw std::invalid_argument("invalid argument " + args[i]);
+}
+
+/// Check that there are no more than @p max arguments.
+void check_args(const std::vector<std::string> &args, std::size_t max)
+{
+	if (args.size() > max) {
+		throw std::invalid_argument("too many arguments");
+	}
+}
+
+Interpolation interpolation_arg(const std::vector<std::string> &args, std::size_t i)
+{
+	return arg(args, i, Interpolation::LINEAR, {
+		{"none", Interpolation::NONE},
+		{"linear", Interpolation::LINEAR},
+		{"cubic", Interpolation::CUBIC},
+		{"allpass", Interpolation::ALLPASS},
+	});
+}
+
+/**
+ * Get the list of module types that can be used in patches.
+ *
+ * The order of the types and of their ports must not change, since the
+ * binary format refers to ports by their index.
+ */
+const std::vector<Type> &types()
+{
+	static const std::vector<Type> the_types = {
+		{"VCO", sizeof(VCO), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 2);
+			return arena.make<VCO>(arg(args, 0, 0.0f), arg(args, 1, VCO::NAIVE, {{"naive", VCO::NAIVE}, {"band_limited", VCO::BAND_LIMITED}}));
+		}, {
+			port<VCO, &VCO::frequency>("frequency"),
+			port<VCO, &VCO::sawtooth_out>("sawtooth_out"),
+			port<VCO, &VCO::sine_out>("sine_out"),
+			port<VCO, &VCO::square_out>("square_out"),
+			port<VCO, &VCO::triangle_out>("triangle_out"),
+		}},
+		{"Envelope", sizeof(Envelope), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 3);
+			return arena.make<Envelope>(arg(args, 0, 0.0f), arg(args, 1, 0.0f), arg(args, 2, 0.0f));
+		}, {
+			port<Envelope, &Envelope::gate_in>("gate_in"),
+			port<Envelope, &Envelope::attack>("attack"),
+			port<Envelope, &Envelope::decay>("decay"),
+			port<Envelope, &Envelope::release>("release"),
+			port<Envelope, &Envelope::amplitude_out>("amplitude_out"),
+		}},
+		{"VCA", sizeof(VCA), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 1);
+			return arena.make<VCA>(arg(args, 0, 0.0f));
+		}, {
+			port<VCA, &VCA::audio_in>("audio_in"),
+			port<VCA, &VCA::amplitude>("amplitude"),
+			port<VCA, &VCA::audio_out>("audio_out"),
+		}},
+		{"VCF", sizeof(VCF), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 2);
+			return arena.make<VCF>(arg(args, 0, 0.0f), arg(args, 1, 0.0f));
+		}, {
+			port<VCF, &VCF::audio_in>("audio_in"),
+			port<VCF, &VCF::cutoff>("cutoff"),
+			port<VCF, &VCF::resonance>("resonance"),
+			port<VCF, &VCF::lowpass_out>("lowpass_out"),
+			port<VCF, &VCF::bandpass_out>("bandpass_out"),
+			port<VCF, &VCF::highpass_out>("highpass_out"),
+		}},
+		{"LinearSlew", sizeof(LinearSlew), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 2);
+			return arena.make<LinearSlew>(arg(args, 0, 1.0f), arg(args, 1, 0.0f));
+		}, {
+			port<LinearSlew, &LinearSlew::in>("in"),
+			port<LinearSlew, &LinearSlew::rate>("rate"),
+			port<LinearSlew, &LinearSlew::out>("out"),
+		}},
+		{"ExponentialSlew", sizeof(ExponentialSlew), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 2);
+			return arena.make<ExponentialSlew>(arg(args, 0, 1.0f), arg(args, 1, 1.0f));
+		}, {
+			port<ExponentialSlew, &ExponentialSlew::in>("in"),
+			port<ExponentialSlew, &ExponentialSlew::rate>("rate"),
+			port<ExponentialSlew, &ExponentialSlew::out>("out"),
+		}},
+		{"Delay", sizeof(Delay), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 2);
+			return arena.make<Delay>(arg(args, 0, 1.0f), interpolation_arg(args, 1));
+		}, {
+			port<Delay, &Delay::in>("in"),
+			port<Delay, &Delay::delay>("delay"),
+			port<Delay, &Delay::out>("out"),
+		}},
+		{"MultiTapDelay", sizeof(MultiTapDelay), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			if (args.empty()) {
+				throw std::invalid_argument("missing number of taps");
+			}
+
+			check_args(args, 3);
+			return arena.make<MultiTapDelay>(arg<std::size_t>(args, 0, 0), arg(args, 1, 1.0f), interpolation_arg(args, 2));
+		}, {
+			port<MultiTapDelay, &MultiTapDelay::in>("in"),
+			port<MultiTapDelay, &MultiTapDelay::delay>("delay"),
+			port<MultiTapDelay, &MultiTapDelay::out>("out"),
+		}},
+		{"Sequencer", sizeof(Sequencer), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			if (args.empty()) {
+				throw std::invalid_argument("missing notes");
+			}
+
+			return arena.make<Sequencer>(args);
+		}, {
+			port<Sequencer, &Sequencer::clock_in>("clock_in"),
+			port<Sequencer, &Sequencer::frequency_out>("frequency_out"),
+			port<Sequencer, &Sequencer::gate_out>("gate_out"),
+			port<Sequencer, &Sequencer::tempo>("tempo"),
+			port<Sequencer, &Sequencer::gate_length>("gate_length"),
+		}},
+		{"Speaker", sizeof(Speaker), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			check_args(args, 1);
+			return arena.make<Speaker>(arg<std::size_t>(args, 0, 0));
+		}, {
+			port<Speaker, &Speaker::left_in>("left_in"),
+			port<Speaker, &Speaker::right_in>("right_in"),
+		}},
+		{"MultichannelSpeaker", sizeof(MultichannelSpeaker), [](Arena &arena, const std::vector<std::string> &args) -> Module & {
+			if (args.empty()) {
+				throw std::invalid_argument("missing number of channels");
+			}
+
+			check_args(args, 2);
+			return arena.make<MultichannelSpeaker>(arg<std::size_t>(args, 0, 0), arg<std::size_t>(args, 1, 0));
+		}, {
+			port<MultichannelSpeaker, &MultichannelSpeaker::in>("in"),
+		}},
+	};
+
+	return the_types;
+}
+
+/**
+ * Find a module type by name.
+ *
+ * This is done for every module and port when loading a patch, so the types
+ * are indexed by name the first time this is called.
+ *
+ * @param name  The name of the type.
+ * @return      A pointer to the type, or nullptr if there is no type with that name.
+ */
+const Type *find_type(const std::string &name)
+{
+	static const auto index = [] {
+		std::unordered_map<std::string, const Type *> result;
+
+		for (auto &type : types()) {
+			result.emplace(type.name, &type);
+		}
+
+		return result;
+	}();
+
+	auto it = index.find(name);
+	return it == index.end() ? nullptr : it->second;
+}
+
+/// The first bytes of a patch in the binary format, including its version.
+const char magic[8] = {'M', 'S', 'P', 'A', 'T', 'C', 'H', '1'};
+
+/**
+ * A reader of values in the binary format.
+ *
+ * All integers are stored as 32-bit little-endian values, floats as the bits
+ * of their IEEE 754 representation, and strings as their length followed by
+ * their characters.
+ */
+struct BinaryReader {
+	const char *ptr; ///< The next byte to read.
+	const char *end; ///< The end of the data.
+
+	void need(std::size_t size)
+	{
+		if (std::size_t(end - ptr) < size) {
+			throw std::runtime_error("truncated patch");
+		}
+	}
+
+	std::uint32_t integer()
+	{
+		need(4);
+		std::uint32_t value{};
+
+		for (std::size_t i = 0; i < 4; i++) {
+			value |= std::uint32_t(static_cast<unsigned char>(*ptr++)) << (8 * i);
+		}
+
+		return value;
+	}
+
+	float number()
+	{
+		auto bits = integer();
+		float value;
+		std::memcpy(&value, &bits, sizeof value);
+		return value;
+	}
+
+	std::string string()
+	{
+		auto size = integer();
+		need(size);
+		std::string value(ptr, size);
+		ptr += size;
+		return value;
+	}
+
+	/// Read a count, checking that the data can actually contain that many items of at least @p size bytes.
+	std::uint32_t count(std::size_t size)
+	{
+		auto value = integer();
+		need(value * size);
+		return value;
+	}
+};
+
+/// Write an integer in the binary format.
+void write_integer(std::ostream &out, std::uint32_t value)
+{
+	for (std::size_t i = 0; i < 4; i++) {
+		out.put(char(value >> (8 * i)));
+	}
+}
+
+/// Write a float in the binary format.
+void write_number(std::ostream &out, float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof bits);
+	write_integer(out, bits);
+}
+
+/// Write a string in the binary format.
+void write_string(std::ostream &out, const std::string &value)
+{
+	write_integer(out, value.size());
+	out.write(value.data(), value.size());
+}
+
+/**
+ * Look up the port a PatchDescription::Port refers to.
+ *
+ * @param description  The description.
+ * @param port         The port.
+ * @return             The port of the module's type.
+ */
+const Port &lookup(const PatchDescription &description, const PatchDescription::Port &port)
+{
+	return find_type(description.modules[port.module].type)->ports[port.port];
+}
+
+/**
+ * Parse the name of a port in the text format.
+ *
+ * @param description  The modules declared so far.
+ * @param names        The index of every module, by name.
+ * @param text         The name of the port.
+ * @param output       Whether the port must be an output.
+ * @return             The port.
+ */
+PatchDescription::Port parse_port(const PatchDescription &description, const std::unordered_map<std::string, std::uint32_t> &names, const std::string &text, bool output)
+{
+	auto dot = text.find('.');
+
+	if (dot == text.npos) {
+		throw std::invalid_argument("invalid port " + text);
+	}
+
+	auto it = names.find(text.substr(0, dot));
+
+	if (it == names.end()) {
+		throw std::invalid_argument("unknown module " + text.substr(0, dot));
+	}
+
+	PatchDescription::Port result{it->second, 0, 0};
+	auto name = text.substr(dot + 1);
+	auto bracket = name.find('[');
+	bool indexed = bracket != name.npos;
+
+	if (indexed) {
+		if (name.back() != ']') {
+			throw std::invalid_argument("invalid port " + text);
+		}
+
+		result.index = parse_number<std::uint32_t>(name.substr(bracket + 1, name.size() - bracket - 2));
+		name.resize(bracket);
+	}
+
+	auto &ports = find_type(description.modules[result.module].type)->ports;
+
+	for (; result.port < ports.size(); result.port++) {
+		auto &port = ports[result.port];
+
+		if (name == port.name) {
+			if (output != !port.input) {
+				throw std::invalid_argument(text + (output ? " is not an output" : " is not an input"));
+			}
+
+			if (indexed != port.vector) {
+				throw std::invalid_argument(indexed ? text + " is not a vector" : text + " needs an index");
+			}
+
+			return result;
+		}
+	}
+
+	throw std::invalid_argument("unknown port " + text);
+}
+
+/// Check that a port read from the binary format exists.
+void check_port(const PatchDescription &description, const PatchDescription::Port &port, bool output)
+{
+	if (port.module >= description.modules.size() || port.port >= find_type(description.modules[port.module].type)->ports.size()) {
+		throw std::runtime_error("invalid port in patch");
+	}
+
+	auto &info = lookup(description, port);
+
+	if (output != !info.input || (!info.vector && port.index)) {
+		throw std::runtime_error("invalid port in patch");
+	}
+}
+
+/// Format the name of a port in the text format.
+std::string format_port(const PatchDescription &description, const PatchDescription::Port &port)
+{
+	auto &info = lookup(description, port);
+	auto text = description.modules[port.module].name + '.' + info.name;
+
+	if (info.vector) {
+		text += '[' + std::to_string(port.index) + ']';
+	}
+
+	return text;
+}
+
+}
+
+PatchDescription parse_patch(std::istream &in)
+{
+	PatchDescription description;
+	std::unordered_map<std::string, std::uint32_t> names;
+	std::string line;
+
+	for (std::size_t number = 1; std::getline(in, line); number++) {
+		line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+		std::istringstream stream(line);
+		std::vector<std::string> words{std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>()};
+
+		if (words.empty()) {
+			continue;
+		}
+
+		try {
+			auto &keyword = words[0];
+
+			if (keyword == "module" && words.size() >= 3) {
+				if (!find_type(words[2])) {
+					throw std::invalid_argument("unknown type " + words[2]);
+				}
+
+				if (!names.emplace(words[1], description.modules.size()).second) {
+					throw std::invalid_argument("duplicate module " + words[1]);
+				}
+
+				description.modules.push_back({words[1], words[2], {words.begin() + 3, words.end()}});
+			} else if (keyword == "set" && words.size() == 3) {
+				description.settings.push_back({parse_port(description, names, words[1], false), parse_number<float>(words[2])});
+			} else if (keyword == "connect" && words.size() == 3) {
+				description.connections.push_back({parse_port(description, names, words[1], true), parse_port(description, names, words[2], false)});
+			} else {
+				throw std::invalid_argument("invalid statement");
+			}
+		} catch (std::invalid_argument &e) {
+			throw std::runtime_error("line " + std::to_string(number) + ": " + e.what());
+		}
+	}
+
+	return description;
+}
+
+void print_patch(std::ostream &out, const PatchDescription &description)
+{
+	for (auto &mod : description.modules) {
+		out << "module " << mod.name << ' ' << mod.type;
+
+		for (auto &arg : mod.args) {
+			out << ' ' << arg;
+		}
+
+		out << '\n';
+	}
+
+	for (auto &setting : description.settings) {
+		// Write the shortest representation that reads back as the same value
+		char value[32];
+		auto ptr = std::to_chars(value, value + sizeof value, setting.value).ptr;
+		out << "set " << format_port(description, setting.input) << ' ' << std::string(value, ptr) << '\n';
+	}
+
+	for (auto &connection : description.connections) {
+		out << "connect " << format_port(description, connection.output) << ' ' << format_port(description, connection.input) << '\n';
+	}
+}
+
+PatchDescription read_patch(std::istream &in)
+{
+	std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+	if (data.compare(0, sizeof magic, magic, sizeof magic)) {
+		throw std::runtime_error("not a binary patch");
+	}
+
+	BinaryReader reader{data.data() + sizeof magic, data.data() + data.size()};
+	PatchDescription description;
+	std::unordered_set<std::string> names;
+
+	description.modules.resize(reader.count(12));
+
+	for (auto &mod : description.modules) {
+		mod.name = reader.string();
+		mod.type = reader.string();
+		mod.args.resize(reader.count(4));
+
+		for (auto &arg : mod.args) {
+			arg = reader.string();
+		}
+
+		if (!find_type(mod.type) || !names.insert(mod.name).second) {
+			throw std::runtime_error("invalid module " + mod.name + " in patch");
+		}
+	}
+
+	auto port = [&reader, &description](bool output) {
+		PatchDescription::Port result;
+		result.module = reader.integer();
+		result.port = reader.integer();
+		result.index = reader.integer();
+		check_port(description, result, output);
+		return result;
+	};
+
+	description.settings.resize(reader.count(16));
+
+	for (auto &setting : description.settings) {
+		setting.input = port(false);
+		setting.value = reader.number();
+	}
+
+	description.connections.resize(reader.count(24));
+
+	for (auto &connection : description.connections) {
+		connection.output = port(true);
+		connection.input = port(false);
+	}
+
+	return description;
+}
+
+void write_patch(std::ostream &out, const PatchDescription &description)
+{
+	auto port = [&out](const PatchDescription::Port &port) {
+		write_integer(out, port.module);
+		write_integer(out, port.port);
+		write_integer(out, port.index);
+	};
+
+	out.write(magic, sizeof magic);
+	write_integer(out, description.modules.size());
+
+	for (auto &mod : description.modules) {
+		write_string(out, mod.name);
+		write_string(out, mod.type);
+		write_integer(out, mod.args.size());
+
+		for (auto &arg : mod.args) {
+			write_string(out, arg);
+		}
+	}
+
+	write_integer(out, description.settings.size());
+
+	for (auto &setting : description.settings) {
+		port(setting.input);
+		write_number(out, setting.value);
+	}
+
+	write_integer(out, description.connections.size());
+
+	for (auto &connection : description.connections) {
+		port(connection.output);
+		port(connection.input);
+	}
+
+	if (!out) {
+		throw std::runtime_error("could not write patch");
+	}
+}
+
+PatchDescription load_patch(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+
+	if (!file) {
+		throw std::runtime_error("could not open " + filename);
+	}
+
+	char header[sizeof magic]{};
+	file.read(header, sizeof header);
+	bool binary = file.gcount() == sizeof magic && !std::memcmp(header, magic, sizeof magic);
+	file.clear();
+	file.seekg(0);
+
+	try {
+		return binary ? read_patch(file) : parse_patch(file);
+	} catch (std::runtime_error &e) {
+		throw std::runtime_error(filename + ": " + e.what());
+	}
+}
+
+Patch::Patch(const PatchDescription &description)
+{
+	load(description);
+}
+
+Patch::~Patch()
+{
+	// The modules are removed together with their arenas, newest first
+	while (!arenas.empty()) {
+		arenas.pop_back();
+	}
+}
+
+/**
+ * Load a description, keeping the modules that did not change.
+ *
+ * All new modules are constructed and all ports are looked up before
+ * anything is changed, so if that throws an exception, destroying the new
+ * arena is all that is needed to leave the patch unchanged. Inputs of kept
+ * modules that were set or connected by the old patch, but not by the new
+ * one, get the value they had before the patch touched them, which also
+ * disconnects them from removed modules. The removed modules are forgotten
+ * in the same schedule that adds the new ones, so the audio thread switches
+ * between the two patches at once.
+ */
+void Patch::load(const PatchDescription &description)
+{
+	std::vector<Instance *> mods;
+	std::vector<const Type *> new_types;
+	std::size_t size = Arena::alignment;
+
+	for (auto &desc : description.modules) {
+		auto it = instances.find(desc.name);
+		auto keep = it != instances.end() && it->second.type == desc.type && it->second.args == desc.args;
+		auto type = keep ? nullptr : find_type(desc.type);
+
+		if (!keep && !type) {
+			throw std::invalid_argument("unknown type " + desc.type);
+		}
+
+		mods.push_back(keep ? &it->second : nullptr);
+		new_types.push_back(type);
+		size += type ? type->size + Arena::alignment : 0;
+	}
+
+	// Make the arena just large enough to hold all new modules in one chunk
+	auto arena = std::make_unique<Arena>(size);
+	std::unordered_map<std::string, Instance> created;
+
+	for (std::size_t i = 0; i < mods.size(); i++) {
+		auto &desc = description.modules[i];
+		auto type = new_types[i];
+
+		if (!type) {
+			continue;
+		}
+
+		try {
+			auto &mod = type->create(*arena, desc.args);
+			mods[i] = &(created[desc.name] = {desc.type, desc.args, &mod, type->size, arena.get(), {}});
+		} catch (std::invalid_argument &e) {
+			throw std::invalid_argument(desc.name + ": " + e.what());
+		}
+	}
+
+	auto resolve_input = [&](const PatchDescription::Port &port) {
+		auto input = lookup(description, port).input;
+		auto result = input ? input(*mods[port.module]->mod, port.index) : nullptr;
+
+		if (!result) {
+			throw std::invalid_argument("invalid input " + format_port(description, port));
+		}
+
+		return result;
+	};
+
+	auto resolve_output = [&](const PatchDescription::Port &port) {
+		auto output = lookup(description, port).output;
+		auto result = output ? output(*mods[port.module]->mod, port.index) : nullptr;
+
+		if (!result) {
+			throw std::invalid_argument("invalid output " + format_port(description, port));
+		}
+
+		return result;
+	};
+
+	std::vector<std::pair<Input *, float>> settings;
+	std::vector<std::pair<Input *, const Output *>> connections;
+	std::unordered_set<Input *> targets;
+
+	for (auto &setting : description.settings) {
+		settings.emplace_back(resolve_input(setting.input), setting.value);
+		targets.insert(settings.back().first);
+	}
+
+	for (auto &connection : description.connections) {
+		connections.emplace_back(resolve_input(connection.input), resolve_output(connection.output));
+		targets.insert(connections.back().first);
+	}
+
+	// From here on, the old patch is changed into the new one
+	std::unordered_set<Instance *> kept(mods.begin(), mods.end());
+	std::vector<std::pair<void *, std::size_t>> removed;
+
+	for (auto &[name, instance] : instances) {
+		if (kept.count(&instance)) {
+			auto &defaults = instance.defaults;
+
+			for (auto &[input, value] : defaults) {
+				if (!targets.count(input)) {
+					*input = value;
+				}
+			}
+
+			defaults.erase(std::remove_if(defaults.begin(), defaults.end(), [&targets](const std::pair<Input *, float> &entry) {
+				return !targets.count(entry.first);
+			}), defaults.end());
+		} else {
+			for (auto &port : find_type(instance.type)->ports) {
+				if (port.input) {
+					for (std::size_t i = 0; auto input = port.input(*instance.mod, i); i++) {
+						input->disconnect();
+					}
+				}
+			}
+
+			removed.emplace_back(instance.mod, instance.size);
+		}
+	}
+
+	auto touch = [&](const PatchDescription::Port &port, Input *input) {
+		auto &defaults = mods[port.module]->defaults;
+
+		if (std::find_if(defaults.begin(), defaults.end(), [input](const std::pair<Input *, float> &entry) {
+			return entry.first == input;
+		}) == defaults.end()) {
+			defaults.emplace_back(input, *input);
+		}
+	};
+
+	for (std::size_t i = 0; i < settings.size(); i++) {
+		touch(description.settings[i].input, settings[i].first);
+		*settings[i].first = settings[i].second;
+	}
+
+	for (std::size_t i = 0; i < connections.size(); i++) {
+		touch(description.connections[i].input, connections[i].first);
+		connections[i].first->connect(*connections[i].second);
+	}
+
+	Registry::get().commit(removed);
+
+	// Keep track of which arenas still contain modules in use
+	std::unordered_map<std::string, Instance> next;
+
+	for (std::size_t i = 0; i < mods.size(); i++) {
+		next.emplace(description.modules[i].name, std::move(*mods[i]));
+	}
+
+	for (auto &[name, instance] : instances) {
+		if (!kept.count(&instance)) {
+			for (auto &entry : arenas) {
+				if (entry.first.get() == instance.arena) {
+					entry.second--;
+				}
+			}
+		}
+	}
+
+	if (!created.empty()) {
+		arenas.emplace_back(std::move(arena), created.size());
+	}
+
+	instances = std::move(next);
+
+	arenas.erase(std::remove_if(arenas.begin(), arenas.end(), [](const std::pair<std::unique_ptr<Arena>, std::size_t> &entry) {
+		return !entry.second;
+	}), arenas.end());
+}
+
+Module *Patch::find(const std::string &name) const
+{
+	auto it = instances.find(name);
+	return it == instances.end() ? nullptr : it->second.mod;
+}
+
+}
@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "modsynth.hpp"
+
+/**
+ * @file patch.hpp
+ * @brief Patches loaded from files.
+ */
+
+namespace ModSynth
+{
+
+/**
+ * @brief A description of a patch: which modules it consists of, and how they are connected.
+ *
+ * Patches are written in a simple text format, with one statement per line,
+ * and comments starting with `#`:
+ *
+ *     module <name> <type> [<argument>...]
+ *     set <name>.<input> <value>
+ *     connect <name>.<output> <name>.<input>
+ *
+ * The types and their constructor arguments are those of the built-in modules,
+ * the ports are the names of their inputs and outputs. Elements of inputs and
+ * outputs that are vectors are written as `<port>[<index>]`. Enumerations are
+ * written in lower case, like `band_limited` or `cubic`. For example:
+ *
+ *     module clock VCO 1
+ *     module sequencer Sequencer C2 D2 Bb1 F1
+ *     module vcf VCF 0 3
+ *     connect clock.square_out sequencer.clock_in
+ *     set vcf.resonance 2
+ *
+ * The text is parsed into a description where all types and ports are already
+ * looked up. This description can also be written in a compact binary format,
+ * which can be loaded without parsing anything but the module arguments.
+ */
+struct PatchDescription {
+	/// A module in the patch.
+	struct Instance {
+		std::string name;              ///< The unique name of the module.
+		std::string type;              ///< The name of the type of the module.
+		std::vector<std::string> args; ///< The arguments passed to the constructor.
+	};
+
+	/// A port of a module in the patch.
+	struct Port {
+		std::uint32_t module; ///< The index of the module in #modules.
+		std::uint32_t port;   ///< The index of the port in the list of ports of the module's type.
+		std::uint32_t index;  ///< The index of the element, for ports that are vectors.
+	};
+
+	/// A constant value for an input.
+	struct Setting {
+		Port input;  ///< The input.
+		float value; ///< The value the input is set to.
+	};
+
+	/// A connection from an output to an input.
+	struct Connection {
+		Port output; ///< The output.
+		Port input;  ///< The input reading from the output.
+	};
+
+	std::vector<Instance> modules;       ///< The modules, in the order they were declared.
+	std::vector<Setting> settings;       ///< The constant values of inputs.
+	std::vector<Connection> connections; ///< The connections between modules.
+};
+
+/**
+ * @brief Parse a patch in the text format.
+ *
+ * @param in  The stream to read the text from.
+ * @return    The description of the patch.
+ */
+PatchDescription parse_patch(std::istream &in);
+
+/**
+ * @brief Write a patch in the text format.
+ *
+ * @param out          The stream to write the text to.
+ * @param description  The description of the patch.
+ */
+void print_patch(std::ostream &out, const PatchDescription &description);
+
+/**
+ * @brief Read a patch in the binary format.
+ *
+ * @param in  The stream to read from, which must be opened in binary mode.
+ * @return    The description of the patch.
+ */
+PatchDescription read_patch(std::istream &in);
+
+/**
+ * @brief Write a patch in the binary format.
+ *
+ * The binary format refers to ports by their position in the list of ports
+ * of each type, so it can only be read by the same version of this library.
+ *
+ * @param out          The stream to write to, which must be opened in binary mode.
+ * @param description  The description of the patch.
+ */
+void write_patch(std::ostream &out, const PatchDescription &description);
+
+/**
+ * @brief Load a patch from a file in either format.
+ *
+ * @param filename  The name of the file.
+ * @return          The description of the patch.
+ */
+PatchDescription load_patch(const std::string &filename);
+
+/**
+ * @brief A set of modules created from a PatchDescription.
+ *
+ * All modules created by a single call to load() are stored next to each
+ * other in an Arena. A patch can be loaded again while the audio output is
+ * active. Modules that have the same name, type and arguments as before are
+ * kept, including all their state, so oscillators keep their phase and
+ * envelopes keep their level. All other modules are created or removed, all
+ * connections and settings are updated, and the audio thread switches to the
+ * new patch between two blocks.
+ *
+ * The memory of a removed module can only be freed once all modules loaded
+ * at the same time are removed.
+ */
+struct Patch {
+	Patch() = default;
+	Patch(const Patch &other) = delete;
+
+	/**
+	 * @brief Construct a patch, and load a description into it.
+	 *
+	 * @param description  The description of the patch.
+	 */
+	explicit Patch(const PatchDescription &description);
+
+	/**
+	 * @brief The destructor.
+	 *
+	 * This removes all modules of the patch, which is safe to do while the
+	 * audio output is active.
+	 */
+	~Patch();
+
+	/**
+	 * @brief Replace the modules of this patch.
+	 *
+	 * This commits all changes, including any made outside of this patch. If
+	 * the description is invalid, an exception is thrown and the patch is left
+	 * unchanged.
+	 *
+	 * @param description  The description of the new patch.
+	 */
+	void load(const PatchDescription &description);
+
+	/**
+	 * @brief Find a module by name.
+	 *
+	 * @param name  The name of the module.
+	 * @return      A pointer to the module, or nullptr if the patch has no module with that name.
+	 */
+	Module *find(const std::string &name) const;
+
+private:
+	/// A module created by this patch.
+	struct Instance {
+		std::string type;                            ///< The name of the type of the module.
+		std::vector<std::string> args;               ///< The arguments passed to the constructor.
+		Module *mod;                                 ///< The module.
+		std::size_t size;                            ///< The size of the module.
+		Arena *arena;                                ///< The arena the module is stored in.
+		std::vector<std::pair<Input *, float>> defaults; ///< The values of inputs set or connected by a patch, before they were.
+	};
+
+	std::unordered_map<std::string, Instance> instances; ///< The modules, by name.
+	std::vector<std::pair<std::unique_ptr<Arena>, std::size_t>> arenas; ///< The arenas, and how many modules in them are still in use.
+};
+
+}
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "modsynth.hpp"
+
+namespace ModSynth
+{
+
+/**
+ * The collector of profiling statistics.
+ *
+ * The counters are only written by the audio thread, or by the worker thread
+ * running a given module, so they are updated with plain relaxed loads and
+ * stores instead of read-modify-write operations. Other threads can read them
+ * at any time without blocking the audio thread.
+ */
+struct Profiler {
+	static inline std::atomic<bool> enabled{}; ///< Whether profiling is enabled.
+
+	/// @name Callback statistics
+	///@{
+	static inline std::atomic<std::uint64_t> callbacks{};
+	static inline std::atomic<std::uint64_t> frames{};
+	static inline std::atomic<std::uint64_t> time{};
+	static inline std::atomic<std::uint64_t> max_time{};
+	static inline std::atomic<std::uint64_t> deadline_misses{};
+	static inline std::atomic<std::uint64_t> xruns{};
+	static inline std::atomic<std::uint64_t> histogram[Profile::buckets]{};
+	///@}
+
+	/**
+	 * Get the current time.
+	 *
+	 * @return The current time in nanoseconds.
+	 */
+	static std::uint64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	 * Run a module, and measure how long it took if profiling is enabled.
+	 *
+	 * @param mod     The module to run.
+	 * @param frames  The number of frames to process.
+	 */
+	static void process(Module *mod, std::size_t frames)
+	{
+		if (!enabled.load(std::memory_order_relaxed)) {
+			mod->process(frames);
+			return;
+		}
+
+		auto start = now();
+		mod->process(frames);
+		auto elapsed = now() - start;
+
+		auto &counters = mod->counters;
+		add(counters.calls, 1);
+		add(counters.time, elapsed);
+		maximize(counters.max_time, elapsed);
+	}
+
+	/**
+	 * Record the time it took to generate audio for the audio backend.
+	 *
+	 * @param start   The time the callback started, as returned by now().
+	 * @param frames  The number of frames generated.
+	 */
+	static void callback(std::uint64_t start, std::size_t frames)
+	{
+		auto elapsed = now() - start;
+		auto deadline = frames * Module::dt * 1e9f;
+		auto bucket = static_cast<std::size_t>(elapsed * 10 / deadline);
+
+		add(callbacks, 1);
+		add(Profiler::frames, frames);
+		add(time, elapsed);
+		maximize(max_time, elapsed);
+
+		if (bucket >= Profile::buckets - 1) {
+			bucket = Profile::buckets - 1;
+			add(deadline_misses, 1);
+		}
+
+		add(histogram[bucket], 1);
+	}
+
+	/**
+	 * Record an underrun reported by the audio backend.
+	 *
+	 * This can be called from any thread.
+	 */
+	static void xrun()
+	{
+		xruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Get the statistics of a module.
+	 *
+	 * @param mod   The module to get the statistics of.
+	 * @param type  The name of the type of the module.
+	 * @return      The statistics of the module.
+	 */
+	static ModuleProfile get(const Module *mod, std::string type)
+	{
+		auto &counters = mod->counters;
+		return {
+			mod,
+			std::move(type),
+			counters.calls.load(std::memory_order_relaxed),
+			counters.time.load(std::memory_order_relaxed),
+			counters.max_time.load(std::memory_order_relaxed),
+		};
+	}
+
+private:
+	/// Add a value to a counter that only has a single writer.
+	static void add(std::atomic<std::uint64_t> &counter, std::uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	/// Update a maximum that only has a single writer.
+	static void maximize(std::atomic<std::uint64_t> &counter, std::uint64_t value)
+	{
+		if (value > counter.load(std::memory_order_relaxed)) {
+			counter.store(value, std::memory_order_relaxed);
+		}
+	}
+};
+
+}
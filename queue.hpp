@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace ModSynth
+{
+
+/**
+ * @brief A lock-free single-producer, single-consumer queue.
+ *
+ * This allows one thread to pass items to another thread without either of
+ * them ever blocking or allocating memory, which makes it suitable for
+ * communicating with the audio thread. The capacity is fixed, and must be a
+ * power of two.
+ */
+template<typename T, std::size_t Size>
+struct SPSCQueue {
+	static_assert(Size && !(Size & (Size - 1)), "the size must be a power of two");
+
+	/**
+	 * @brief Add an item to the queue.
+	 *
+	 * This must only be called by the producer thread.
+	 *
+	 * @param item  The item to add.
+	 * @return      True if the item was added, false if the queue was full.
+	 */
+	bool push(const T &item)
+	{
+		auto tail = this->tail.load(std::memory_order_relaxed);
+
+		if (tail - head.load(std::memory_order_acquire) == Size) {
+			return false;
+		}
+
+		items[tail & (Size - 1)] = item;
+		this->tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Remove the oldest item from the queue.
+	 *
+	 * This must only be called by the consumer thread.
+	 *
+	 * @param[out] item  The removed item.
+	 * @return           True if an item was removed, false if the queue was empty.
+	 */
+	bool pop(T &item)
+	{
+		auto head = this->head.load(std::memory_order_relaxed);
+
+		if (head == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = items[head & (Size - 1)];
+		this->head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	alignas(64) std::atomic<std::size_t> head{}; ///< The number of items removed so far.
+	alignas(64) std::atomic<std::size_t> tail{}; ///< The number of items added so far.
+	T items[Size];                              ///< The storage for the items.
+};
+
+/**
+ * @brief A lock-free multiple-producer, single-consumer queue.
+ *
+ * Like SPSCQueue, but any number of threads can add items at the same time.
+ * Every slot has a sequence number that tells whether it is free, or holds an
+ * item that is ready to be removed, so producers only have to agree on the
+ * position to write to. Several items can be added at once, in which case
+ * they end up next to each other, and the consumer can check whether all of
+ * them are ready before removing any. The capacity is fixed, and must be a
+ * power of two.
+ */
+template<typename T, std::size_t Size>
+struct MPSCQueue {
+	static_assert(Size && !(Size & (Size - 1)), "the size must be a power of two");
+
+	MPSCQueue()
+	{
+		for (std::size_t i = 0; i < Size; i++) {
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @brief Add an item to the queue.
+	 *
+	 * This can be called by any thread.
+	 *
+	 * @param item  The item to add.
+	 * @return      True if the item was added, false if the queue was full.
+	 */
+	bool push(const T &item)
+	{
+		return push(&item, 1);
+	}
+
+	/**
+	 * @brief Add consecutive items to the queue.
+	 *
+	 * This can be called by any thread. Either all items are added, or none.
+	 *
+	 * @param items  The items to add.
+	 * @param count  The number of items.
+	 * @return       True if the items were added, false if the queue did not have room for all of them.
+	 */
+	bool push(const T *items, std::size_t count)
+	{
+		if (!count || count > Size) {
+			return !count;
+		}
+
+		auto tail = this->tail.load(std::memory_order_relaxed);
+
+		// Slots are freed in order, so if the last one is free, all of them are
+		while (true) {
+			auto last = tail + count - 1;
+			auto sequence = slots[last & (Size - 1)].sequence.load(std::memory_order_acquire);
+
+			if (sequence == last) {
+				if (this->tail.compare_exchange_weak(tail, tail + count, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (std::ptrdiff_t(sequence - last) < 0) {
+				return false;
+			} else {
+				tail = this->tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		for (std::size_t i = 0; i < count; i++) {
+			auto &slot = slots[(tail + i) & (Size - 1)];
+			slot.item = items[i];
+			slot.sequence.store(tail + i + 1, std::memory_order_release);
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Check whether a number of items are ready to be removed.
+	 *
+	 * This must only be called by the consumer thread.
+	 *
+	 * @param count  The number of items.
+	 * @return       True if the next @p count items can be removed.
+	 */
+	bool available(std::size_t count = 1) const
+	{
+		for (std::size_t i = 0; i < count; i++) {
+			if (slots[(head + i) & (Size - 1)].sequence.load(std::memory_order_acquire) != head + i + 1) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @brief Look at the oldest item in the queue without removing it.
+	 *
+	 * This must only be called by the consumer thread.
+	 *
+	 * @return  A pointer to the item, or nullptr if the queue is empty.
+	 */
+	const T *front() const
+	{
+		return available() ? &slots[head & (Size - 1)].item : nullptr;
+	}
+
+	/**
+	 * @brief Remove the oldest item from the queue.
+	 *
+	 * This must only be called by the consumer thread.
+	 *
+	 * @param[out] item  The removed item.
+	 * @return           True if an item was removed, false if the queue was empty.
+	 */
+	bool pop(T &item)
+	{
+		if (!available()) {
+			return false;
+		}
+
+		auto &slot = slots[head & (Size - 1)];
+		item = slot.item;
+		slot.sequence.store(head + Size, std::memory_order_release);
+		head++;
+		return true;
+	}
+
+private:
+	/// A slot for one item.
+	struct Slot {
+		std::atomic<std::size_t> sequence; ///< The position this slot is free for, or one more than the position of the item it holds.
+		T item;                            ///< The item.
+	};
+
+	alignas(64) std::atomic<std::size_t> tail{}; ///< The number of items producers have reserved room for.
+	alignas(64) std::size_t head{};              ///< The number of items removed so far, only used by the consumer.
+	Slot slots[Size];                            ///< The storage for the items.
+};
+
+}
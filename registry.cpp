@@ -0,0 +1,1217 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "registry.hpp"
+#include "profile.hpp"
+#include "tap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace ModSynth
+{
+
+thread_local Module *Registry::constructing;
+
+Registry &Registry::get()
+{
+	static Registry the_registry;
+	return the_registry;
+}
+
+Registry::~Registry()
+{
+	for (auto &item : garbage) {
+		item.destroy(item.object);
+	}
+
+	delete current;
+	delete pending.load();
+
+	for (auto schedule = retired.load(); schedule;) {
+		auto next = schedule->next;
+		delete schedule;
+		schedule = next;
+	}
+}
+
+/**
+ * Add a module to the registry.
+ *
+ * The module will not be run until the next commit.
+ *
+ * @param mod  The module to add.
+ */
+void Registry::add(Module *mod)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	added.push_back(mod);
+}
+
+/**
+ * Remove a module from the registry.
+ *
+ * If the module was committed, this publishes a new schedule without it, and
+ * waits until the audio thread no longer uses the old schedule.
+ *
+ * @param mod  The module to remove, if it is registered.
+ */
+void Registry::remove(Module *mod)
+{
+	std::uint64_t wait{};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		writers.erase(std::remove_if(writers.begin(), writers.end(), [mod](const std::pair<Module *, Input *> &writer) {
+			return writer.first == mod;
+		}), writers.end());
+
+		readers.erase(std::remove_if(readers.begin(), readers.end(), [mod](const std::pair<Module *, const Output *> &reader) {
+			return reader.first == mod || reader.second->owner == mod;
+		}), readers.end());
+
+		sleepers.erase(std::remove_if(sleepers.begin(), sleepers.end(), [mod](const std::pair<Module *, const Module *> &sleeper) {
+			return sleeper.first == mod;
+		}), sleepers.end());
+
+		// Modules sleeping with this module will be woken up
+		for (auto &sleeper : sleepers) {
+			if (sleeper.second == mod) {
+				sleeper.second = nullptr;
+			}
+		}
+
+		nested.erase(std::remove_if(nested.begin(), nested.end(), [mod](const Nesting &nesting) {
+			return nesting.child == mod || nesting.container == mod;
+		}), nested.end());
+
+		released.erase(std::remove_if(released.begin(), released.end(), [mod](const std::pair<const Output *, std::uint64_t> &output) {
+			return output.first->owner == mod;
+		}), released.end());
+
+		// Inputs of other modules can no longer read from this module's outputs
+		for (auto input : connections) {
+			if (input->source->owner == mod) {
+				input->source = nullptr;
+				disconnected.emplace_back(input, 0);
+			}
+		}
+
+		connections.erase(std::remove_if(connections.begin(), connections.end(), [](const Input *input) {
+			return !input->source;
+		}), connections.end());
+
+		auto it = std::find(added.begin(), added.end(), mod);
+
+		if (it != added.end()) {
+			// The audio thread has never seen this module
+			added.erase(it);
+			return;
+		}
+
+		it = std::find(modules.begin(), modules.end(), mod);
+
+		if (it == modules.end()) {
+			return;
+		}
+
+		modules.erase(it);
+		publish();
+		wait = generation;
+	}
+
+	synchronize(wait);
+}
+
+/**
+ * Remove an input that is being destroyed from the registry.
+ *
+ * @param input  The input to remove.
+ */
+void Registry::remove(Input *input)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	forget(input, input + 1);
+}
+
+/**
+ * Remove an output that is being destroyed from the registry.
+ *
+ * If the output is connected or read by another module, this publishes a new
+ * schedule without it, and waits until the audio thread no longer uses the
+ * old schedule.
+ *
+ * @param output  The output to remove.
+ */
+void Registry::remove(const Output *output)
+{
+	std::uint64_t wait{};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		bool used = std::any_of(connections.begin(), connections.end(), [output](const Input *input) {
+			return input->source == output;
+		}) || std::any_of(readers.begin(), readers.end(), [output](const std::pair<Module *, const Output *> &reader) {
+			return reader.second == output;
+		}) || std::any_of(released.begin(), released.end(), [output](const std::pair<const Output *, std::uint64_t> &entry) {
+			return entry.first == output;
+		});
+
+		auto begin = const_cast<Output *>(output);
+		forget(begin, begin + 1);
+
+		if (!used) {
+			return;
+		}
+
+		publish();
+		wait = generation;
+	}
+
+	synchronize(wait);
+}
+
+/**
+ * Remove all modules contained in an object, and destroy it when it is no longer in use.
+ *
+ * @param object   A pointer to the object.
+ * @param size     The size of the object.
+ * @param destroy  The function that destroys the object.
+ */
+void Registry::remove(void *object, std::size_t size, void (*destroy)(void *))
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto begin = static_cast<char *>(object);
+		forget(begin, begin + size);
+		publish();
+		garbage.push_back({object, destroy, generation});
+
+		if (!running) {
+			adopt();
+		}
+	}
+
+	reclaim();
+}
+
+/**
+ * Stop copying the final mix to a tap that is being destroyed.
+ *
+ * If it is the current tap, this publishes a new schedule without it, and
+ * waits until the audio thread no longer uses the old schedule.
+ *
+ * @param tap  The tap being destroyed.
+ */
+void Registry::remove(TapBuffer *tap)
+{
+	std::uint64_t wait{};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (this->tap != tap) {
+			return;
+		}
+
+		this->tap = nullptr;
+		publish();
+		wait = generation;
+	}
+
+	synchronize(wait);
+}
+
+/**
+ * Forget about all modules and inputs in a range of memory.
+ *
+ * Inputs and outputs belonging to modules in that range are forgotten as
+ * well, even if they are stored elsewhere, like the elements of a std::vector.
+ * Inputs connected to outputs in that range are disconnected.
+ *
+ * @param begin  The start of the range.
+ * @param end    One past the end of the range.
+ */
+void Registry::forget(void *begin, void *end)
+{
+	auto inside = [begin, end](const void *ptr) {
+		return std::less_equal<const void *>()(begin, ptr) && std::less<const void *>()(ptr, end);
+	};
+
+	auto inside_input = [&inside](const Input *input) {
+		return inside(input) || inside(input->owner);
+	};
+
+	auto inside_output = [&inside](const Output *output) {
+		return inside(output) || inside(output->owner);
+	};
+
+	auto remove_inside = [&inside](std::vector<Module *> &mods) {
+		mods.erase(std::remove_if(mods.begin(), mods.end(), inside), mods.end());
+	};
+
+	remove_inside(modules);
+	remove_inside(added);
+
+	writers.erase(std::remove_if(writers.begin(), writers.end(), [&](const std::pair<Module *, Input *> &writer) {
+		return inside(writer.first) || inside_input(writer.second);
+	}), writers.end());
+
+	readers.erase(std::remove_if(readers.begin(), readers.end(), [&](const std::pair<Module *, const Output *> &reader) {
+		return inside(reader.first) || inside_output(reader.second);
+	}), readers.end());
+
+	sleepers.erase(std::remove_if(sleepers.begin(), sleepers.end(), [&inside](const std::pair<Module *, const Module *> &sleeper) {
+		return inside(sleeper.first);
+	}), sleepers.end());
+
+	for (auto &sleeper : sleepers) {
+		if (inside(sleeper.second)) {
+			sleeper.second = nullptr;
+		}
+	}
+
+	nested.erase(std::remove_if(nested.begin(), nested.end(), [&inside](const Nesting &nesting) {
+		return inside(nesting.child) || inside(nesting.container);
+	}), nested.end());
+
+	disconnected.erase(std::remove_if(disconnected.begin(), disconnected.end(), [&inside_input](const std::pair<Input *, std::uint64_t> &input) {
+		return inside_input(input.first);
+	}), disconnected.end());
+
+	released.erase(std::remove_if(released.begin(), released.end(), [&inside_output](const std::pair<const Output *, std::uint64_t> &output) {
+		return inside_output(output.first);
+	}), released.end());
+
+	for (auto input : connections) {
+		if (!inside_input(input) && inside_output(input->source)) {
+			input->source = nullptr;
+			disconnected.emplace_back(input, 0);
+		} else if (inside_input(input) && !inside_output(input->source)) {
+			released.emplace_back(input->source, 0);
+		}
+	}
+
+	connections.erase(std::remove_if(connections.begin(), connections.end(), [&inside_input](const Input *input) {
+		return inside_input(input) || !input->source;
+	}), connections.end());
+}
+
+/**
+ * Connect an input to an output.
+ *
+ * The input will read from the output after the next commit.
+ *
+ * @param input   The input to connect.
+ * @param output  The output to connect to.
+ */
+void Registry::connect(Input *input, const Output *output)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	input->detach.store(false, std::memory_order_relaxed);
+
+	if (!input->source) {
+		connections.push_back(input);
+	} else if (input->source != output) {
+		released.emplace_back(input->source, 0);
+	}
+
+	input->source = output;
+
+	disconnected.erase(std::remove_if(disconnected.begin(), disconnected.end(), [input](const std::pair<Input *, std::uint64_t> &entry) {
+		return entry.first == input;
+	}), disconnected.end());
+}
+
+/**
+ * Disconnect an input.
+ *
+ * The input will read its constant value after the next commit.
+ *
+ * @param input  The input to disconnect.
+ */
+void Registry::disconnect(Input *input)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	input->detach.store(false, std::memory_order_relaxed);
+	detach(input);
+}
+
+/**
+ * Disconnect an input while already holding the mutex.
+ *
+ * @param input  The input to disconnect.
+ */
+void Registry::detach(Input *input)
+{
+	if (!input->source) {
+		return;
+	}
+
+	released.emplace_back(input->source, 0);
+	input->source = nullptr;
+	connections.erase(std::remove(connections.begin(), connections.end(), input), connections.end());
+	disconnected.emplace_back(input, 0);
+}
+
+/**
+ * Register a module that writes to an input of another module.
+ *
+ * This ensures the module writing to the input runs before the module the
+ * input belongs to, even though they are not connected.
+ *
+ * @param mod    The module writing to the input.
+ * @param input  The input being written to.
+ */
+void Registry::write(Module *mod, Input *input)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	writers.emplace_back(mod, input);
+}
+
+/**
+ * Register a module that reads from an output of another module.
+ *
+ * This ensures the module reading from the output runs after the module the
+ * output belongs to, and that the output is computed even though it is not
+ * connected to any input.
+ *
+ * @param mod     The module reading from the output.
+ * @param output  The output being read from.
+ */
+void Registry::read(Module *mod, const Output *output)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	readers.emplace_back(mod, output);
+}
+
+/**
+ * Let a module sleep while another module is idle.
+ *
+ * This ensures the module runs after the module it sleeps with.
+ *
+ * @param mod         The module that should sleep.
+ * @param controller  The module it sleeps with, or nullptr to never let it sleep.
+ */
+void Registry::sleep(Module *mod, const Module *controller)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto &sleeper : sleepers) {
+		if (sleeper.first == mod) {
+			sleeper.second = controller;
+			return;
+		}
+	}
+
+	sleepers.emplace_back(mod, controller);
+}
+
+/**
+ * Let a module be run by another module instead of by the schedule.
+ *
+ * The container runs the module using Module::run_children(). The module is
+ * prepared right away for the time step it will be run with.
+ *
+ * @param child      The module to nest.
+ * @param container  The module that will run it.
+ * @param scale      The factor Module::dt is multiplied with while the container runs it.
+ */
+void Registry::nest(Module *child, Module *container, float scale)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = std::find_if(nested.begin(), nested.end(), [child](const Nesting &nesting) {
+		return nesting.child == child;
+	});
+
+	if (it == nested.end()) {
+		nested.push_back({child, container, scale});
+	} else {
+		*it = {child, container, scale};
+	}
+
+	auto saved = Module::dt;
+	Module::dt = saved * this->scale(child);
+	child->prepare();
+	Module::dt = saved;
+}
+
+/**
+ * Check that a list of modules is in an order they can be run in.
+ *
+ * Modules that run a fixed list of other modules themselves, like
+ * StaticGraph, use this to check that list against the connections that are
+ * known so far. Connections to modules outside the list are ignored.
+ *
+ * @param order  The modules, in the order they will be run.
+ * @throw std::invalid_argument if a module depends on a module that comes after it.
+ */
+void Registry::check_order(const std::vector<const Module *> &order)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unordered_map<const Module *, size_t> position;
+
+	for (size_t i = 0; i < order.size(); i++) {
+		position[order[i]] = i;
+	}
+
+	auto check = [&](const Module *from, const Module *to) {
+		auto from_it = position.find(from);
+		auto to_it = position.find(to);
+
+		if (from_it != position.end() && to_it != position.end() && from_it->second > to_it->second) {
+			throw std::invalid_argument("module " + std::to_string(to_it->second) + " depends on module " + std::to_string(from_it->second) + " which runs after it");
+		}
+	};
+
+	for (auto input : connections) {
+		check(input->source->owner, input->owner);
+	}
+
+	for (auto &writer : writers) {
+		check(writer.first, writer.second->owner);
+	}
+
+	for (auto &reader : readers) {
+		check(reader.second->owner, reader.first);
+	}
+
+	for (auto &sleeper : sleepers) {
+		check(sleeper.second, sleeper.first);
+	}
+}
+
+/**
+ * Copy the final mix to a tap.
+ *
+ * This publishes a new schedule with the tap, and waits until the audio
+ * thread uses it, so the previous tap is no longer written to.
+ *
+ * @param tap  The tap, or nullptr to stop copying the mix.
+ */
+void Registry::set_tap(TapBuffer *tap)
+{
+	std::uint64_t wait{};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->tap = tap;
+		publish();
+		wait = generation;
+	}
+
+	synchronize(wait);
+}
+
+/**
+ * Get the factor by which the time step of a module differs from that of the audio output.
+ *
+ * This must be called with #mutex held.
+ *
+ * @param mod  The module.
+ * @return     The product of the scales of all the containers the module is nested in.
+ */
+float Registry::scale(const Module *mod) const
+{
+	float result = 1;
+
+	// Stop at the number of nestings, so a loop of containers cannot hang
+	for (size_t depth = 0; depth < nested.size(); depth++) {
+		auto it = std::find_if(nested.begin(), nested.end(), [mod](const Nesting &nesting) {
+			return nesting.child == mod;
+		});
+
+		if (it == nested.end()) {
+			break;
+		}
+
+		result *= it->scale;
+		mod = it->container;
+	}
+
+	return result;
+}
+
+/**
+ * Commit all the changes made to modules and connections.
+ *
+ * This publishes a new schedule including all the modules added since the
+ * last commit. If audio is not running, the new schedule is adopted right
+ * away.
+ */
+void Registry::commit()
+{
+	commit({});
+}
+
+/**
+ * Commit all changes, and remove all modules in some ranges of memory in the same schedule.
+ *
+ * This lets the audio thread switch from one set of modules to another
+ * between two blocks. The memory is not destroyed, the caller must keep it
+ * alive until the audio thread has adopted a later schedule, for example by
+ * passing it to remove() afterwards.
+ *
+ * @param removed  The start and size of each range of memory.
+ */
+void Registry::commit(const std::vector<std::pair<void *, std::size_t>> &removed)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto [object, size] : removed) {
+			auto begin = static_cast<char *>(object);
+			forget(begin, begin + size);
+		}
+
+		// Disconnect the inputs that were assigned a constant value since the last commit
+		std::vector<Input *> detached;
+
+		for (auto input : connections) {
+			if (input->detach.exchange(false, std::memory_order_relaxed)) {
+				detached.push_back(input);
+			}
+		}
+
+		for (auto input : detached) {
+			detach(input);
+		}
+
+		modules.insert(modules.end(), added.begin(), added.end());
+		added.clear();
+		publish();
+
+		if (!running) {
+			adopt();
+		}
+	}
+
+	reclaim();
+}
+
+/**
+ * Compile and publish a new schedule.
+ *
+ * This must be called with #mutex held. If a previously published schedule has
+ * not been adopted by the audio thread yet, it is replaced.
+ */
+void Registry::publish()
+{
+	auto schedule = compile();
+	schedule->generation = ++generation;
+
+	for (auto &input : disconnected) {
+		if (!input.second) {
+			input.second = generation;
+		}
+	}
+
+	for (auto &output : released) {
+		if (!output.second) {
+			output.second = generation;
+		}
+	}
+
+	delete pending.exchange(schedule, std::memory_order_acq_rel);
+}
+
+/**
+ * Wait until the audio thread has adopted a given schedule.
+ *
+ * If audio is not running, the schedule is adopted by the calling thread.
+ *
+ * @param generation  The generation of the schedule to wait for.
+ */
+void Registry::synchronize(std::uint64_t generation)
+{
+	while (adopted.load(std::memory_order_acquire) < generation) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (!running) {
+				adopt();
+				continue;
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	reclaim();
+}
+
+/**
+ * Free schedules and destroy objects that are no longer in use by the audio thread.
+ */
+void Registry::reclaim()
+{
+	for (auto schedule = retired.exchange(nullptr, std::memory_order_acquire); schedule;) {
+		auto next = schedule->next;
+		delete schedule;
+		schedule = next;
+	}
+
+	std::vector<Garbage> unused;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto generation = adopted.load(std::memory_order_acquire);
+
+		auto it = std::partition(garbage.begin(), garbage.end(), [generation](const Garbage &item) {
+			return item.generation > generation;
+		});
+
+		unused.assign(it, garbage.end());
+		garbage.erase(it, garbage.end());
+
+		disconnected.erase(std::remove_if(disconnected.begin(), disconnected.end(), [generation](const std::pair<Input *, std::uint64_t> &input) {
+			return input.second && input.second <= generation;
+		}), disconnected.end());
+
+		released.erase(std::remove_if(released.begin(), released.end(), [generation](const std::pair<const Output *, std::uint64_t> &output) {
+			return output.second && output.second <= generation;
+		}), released.end());
+	}
+
+	for (auto &item : unused) {
+		item.destroy(item.object);
+	}
+}
+
+/**
+ * Tell the registry whether the audio thread might be running.
+ *
+ * This must be set before the audio thread is started, and cleared only when
+ * the audio thread is guaranteed to have stopped.
+ *
+ * @param running  Whether the audio thread might be running.
+ */
+void Registry::set_running(bool running)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->running = running;
+
+		if (!running) {
+			adopt();
+		} else if (tap) {
+			// The last schedule might have been adopted by a thread with a different time step
+			tap->prepare();
+		}
+	}
+
+	reclaim();
+}
+
+/**
+ * Prepare all modules for a new sample rate.
+ *
+ * This is called after Module::dt has changed, while the audio output is not
+ * active, so modules can resize or reset any state that depends on it. Nested
+ * modules are prepared with the time step their container runs them with.
+ */
+void Registry::prepare()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto saved = Module::dt;
+
+	auto prepare = [this, saved](Module *mod) {
+		Module::dt = saved * scale(mod);
+		mod->prepare();
+	};
+
+	std::for_each(modules.begin(), modules.end(), prepare);
+	std::for_each(added.begin(), added.end(), prepare);
+	Module::dt = saved;
+}
+
+/**
+ * Adopt a newly published schedule.
+ *
+ * This is called by the audio thread at the start of a block. It never blocks
+ * or allocates memory, the old schedule is handed back to the control threads
+ * to be freed.
+ *
+ * @return True if a new schedule was adopted.
+ */
+bool Registry::adopt()
+{
+	auto schedule = pending.exchange(nullptr, std::memory_order_acq_rel);
+
+	if (!schedule) {
+		return false;
+	}
+
+	for (auto &buffer : schedule->buffers) {
+		buffer.first->buffer = buffer.second;
+	}
+
+	for (auto &output : schedule->outputs) {
+		output.first->used = output.second;
+	}
+
+	for (auto &controller : schedule->controllers) {
+		controller.first->controller = controller.second;
+	}
+
+	// Containers only run the modules nested in them according to the new schedule
+	if (current) {
+		for (auto &container : current->children) {
+			container.first->children = nullptr;
+		}
+	}
+
+	for (auto &container : schedule->children) {
+		container.first->children = &container.second;
+	}
+
+	// A tap that starts receiving the final mix gets the sample rate of the audio output
+	if (schedule->tap && schedule->tap != (current ? current->tap : nullptr)) {
+		schedule->tap->prepare();
+	}
+
+	if (current) {
+		current->next = retired.load(std::memory_order_relaxed);
+
+		while (!retired.compare_exchange_weak(current->next, current, std::memory_order_release, std::memory_order_relaxed)) {
+		}
+	}
+
+	current = schedule;
+	adopted.store(schedule->generation, std::memory_order_release);
+
+	return true;
+}
+
+/**
+ * Compile a new schedule.
+ *
+ * This builds a graph of the committed modules, where each connection from an
+ * output of one module to an input of another module is an edge. Any edges
+ * that close a cycle are turned into feedback connections. The remaining
+ * edges form a directed acyclic graph, which is sorted topologically, so
+ * every module is run after all the modules it reads from. Modules whose order
+ * is not determined by a connection will run in order of registration. If all
+ * modules natively process blocks, modules that do not depend on each other
+ * are grouped by type instead, so modules of the same type run in batches.
+ *
+ * For the worker threads, the modules are split into tasks. A module joins the
+ * task of the modules it feeds if they are all in the same task, so a chain of
+ * modules per voice becomes one task, while a module shared by several voices,
+ * like a clock or an LFO, gets a task of its own. The tasks are run in stages,
+ * each stage after all the stages feeding it, and the tasks within a stage
+ * run at the same time.
+ *
+ * This must be called with #mutex held.
+ *
+ * @return A newly allocated schedule.
+ */
+Registry::Schedule *Registry::compile()
+{
+	auto schedule = new Schedule;
+	schedule->tap = tap;
+	size_t n = modules.size();
+	std::unordered_map<const Module *, size_t> index;
+
+	for (size_t i = 0; i < n; i++) {
+		index[modules[i]] = i;
+	}
+
+	// Find the container of every nested module
+	const size_t none = -1;
+	std::vector<size_t> parent(n, none);
+
+	for (auto &nesting : nested) {
+		auto child = index.find(nesting.child);
+		auto container = index.find(nesting.container);
+
+		if (child != index.end() && container != index.end()) {
+			parent[child->second] = container->second;
+		}
+	}
+
+	auto depth = [&parent, n](size_t i) {
+		size_t result = 0;
+
+		while (parent[i] != none && result < n) {
+			i = parent[i];
+			result++;
+		}
+
+		return result;
+	};
+
+	// Collect the edges between committed modules
+	struct Edge {
+		size_t from;
+		size_t to;
+		Input *input;
+		bool nested; ///< Whether the edge was moved to containers of the modules it connects.
+	};
+
+	std::vector<Edge> edges;
+	std::vector<std::vector<size_t>> outgoing(n);
+
+	auto add_edge = [&](const Module *from_mod, const Module *to_mod, Input *input) {
+		auto from_it = index.find(from_mod);
+		auto to_it = index.find(to_mod);
+
+		if (from_it == index.end() || to_it == index.end()) {
+			return;
+		}
+
+		// Edges only order modules run by the same container, so move up to the containers that are siblings
+		auto from = from_it->second;
+		auto to = to_it->second;
+		auto from_depth = depth(from);
+		auto to_depth = depth(to);
+
+		for (; from_depth > to_depth; from_depth--) {
+			from = parent[from];
+		}
+
+		for (; to_depth > from_depth; to_depth--) {
+			to = parent[to];
+		}
+
+		while (parent[from] != parent[to]) {
+			from = parent[from];
+			to = parent[to];
+		}
+
+		if (from == to) {
+			return;
+		}
+
+		outgoing[from].push_back(edges.size());
+		edges.push_back({from, to, input, from != from_it->second || to != to_it->second});
+	};
+
+	for (auto input : connections) {
+		add_edge(input->source->owner, input->owner, input);
+	}
+
+	for (auto &writer : writers) {
+		add_edge(writer.first, writer.second->owner, nullptr);
+	}
+
+	for (auto &reader : readers) {
+		add_edge(reader.second->owner, reader.first, nullptr);
+	}
+
+	for (auto &sleeper : sleepers) {
+		add_edge(sleeper.second, sleeper.first, nullptr);
+	}
+
+	// Find the edges closing a cycle using a depth-first search
+	enum {UNVISITED, VISITING, VISITED};
+	std::vector<int> state(n, UNVISITED);
+	std::vector<bool> feedback(edges.size());
+	std::vector<std::pair<size_t, size_t>> stack;
+
+	for (size_t root = 0; root < n; root++) {
+		if (state[root] != UNVISITED) {
+			continue;
+		}
+
+		state[root] = VISITING;
+		stack.emplace_back(root, 0);
+
+		while (!stack.empty()) {
+			auto &top = stack.back();
+
+			if (top.second == outgoing[top.first].size()) {
+				state[top.first] = VISITED;
+				stack.pop_back();
+				continue;
+			}
+
+			auto edge = outgoing[top.first][top.second++];
+			auto to = edges[edge].to;
+
+			if (state[to] == VISITING) {
+				feedback[edge] = true;
+			} else if (state[to] == UNVISITED) {
+				state[to] = VISITING;
+				stack.emplace_back(to, 0);
+			}
+		}
+	}
+
+	// Sort the modules topologically, preferring the order of registration
+	std::vector<size_t> incoming(n);
+
+	for (size_t i = 0; i < edges.size(); i++) {
+		if (!feedback[i]) {
+			incoming[edges[i].to]++;
+		}
+	}
+
+	std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+	std::vector<std::vector<Module *>> children(n);
+	std::vector<size_t> level(n);
+
+	for (size_t i = 0; i < n; i++) {
+		if (!incoming[i]) {
+			ready.push(i);
+		}
+	}
+
+	while (!ready.empty()) {
+		auto i = ready.top();
+		ready.pop();
+
+		// Nested modules are run by their container instead
+		if (parent[i] == none) {
+			schedule->modules.push_back(modules[i]);
+		} else {
+			children[parent[i]].push_back(modules[i]);
+		}
+
+		for (auto edge : outgoing[i]) {
+			if (feedback[edge]) {
+				continue;
+			}
+
+			auto to = edges[edge].to;
+			level[to] = std::max(level[to], level[i] + 1);
+
+			if (!--incoming[to]) {
+				ready.push(to);
+			}
+		}
+	}
+
+	schedule->block_processing = std::all_of(modules.begin(), modules.end(), [](const Module *mod) {
+		return mod->block_processing();
+	});
+
+	// Group modules of the same type within each level, unless update() functions might depend on the order of registration
+	if (schedule->block_processing) {
+		std::unordered_map<std::type_index, size_t> type_rank;
+		std::vector<size_t> rank(n);
+
+		for (size_t i = 0; i < n; i++) {
+			rank[i] = type_rank.emplace(typeid(*modules[i]), type_rank.size()).first->second;
+		}
+
+		std::stable_sort(schedule->modules.begin(), schedule->modules.end(), [&](const Module *a, const Module *b) {
+			auto i = index[a];
+			auto j = index[b];
+			return std::tie(level[i], rank[i]) < std::tie(level[j], rank[j]);
+		});
+	}
+
+	for (size_t begin = 0, end; begin < schedule->modules.size(); begin = end) {
+		auto &type = typeid(*schedule->modules[begin]);
+
+		for (end = begin + 1; end < schedule->modules.size() && typeid(*schedule->modules[end]) == type; end++) {
+		}
+
+		schedule->batches.push_back({begin, end});
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (!children[i].empty()) {
+			schedule->children.emplace_back(modules[i], std::move(children[i]));
+		}
+	}
+
+	// Insert a one block delay in every feedback connection, nested modules just read the previous values of their inputs
+	std::unordered_map<const Input *, size_t> delayed;
+
+	for (size_t i = 0; i < edges.size(); i++) {
+		if (feedback[i] && edges[i].input && !edges[i].nested) {
+			delayed[edges[i].input] = schedule->feedback.size();
+			schedule->feedback.emplace_back();
+			schedule->feedback.back().source = edges[i].input->source->buffer;
+		}
+	}
+
+	// Tell every connected input which buffer to read from
+	for (auto input : connections) {
+		auto it = delayed.find(input);
+		auto buffer = it == delayed.end() ? input->source->buffer : schedule->feedback[it->second].buffer;
+		schedule->buffers.emplace_back(input, buffer);
+	}
+
+	for (auto &input : disconnected) {
+		schedule->buffers.emplace_back(input.first, nullptr);
+	}
+
+	// Tell every output whether it is read from, outputs that are still read take precedence
+	for (auto &output : released) {
+		schedule->outputs.emplace_back(output.first, false);
+	}
+
+	for (auto input : connections) {
+		schedule->outputs.emplace_back(input->source, true);
+	}
+
+	for (auto &reader : readers) {
+		schedule->outputs.emplace_back(reader.second, true);
+	}
+
+	// Only let modules sleep once they are run after the module they sleep with
+	for (auto &sleeper : sleepers) {
+		schedule->controllers.emplace_back(sleeper.first, index.count(sleeper.second) ? sleeper.second : nullptr);
+	}
+
+	// Give every module its own task, unless all the modules it feeds are in the same task
+	std::vector<size_t> task(n, none);
+	size_t tasks = 0;
+
+	for (auto it = schedule->modules.rbegin(); it != schedule->modules.rend(); ++it) {
+		auto i = index[*it];
+		size_t target = none;
+		bool shared = false;
+
+		for (auto edge : outgoing[i]) {
+			if (feedback[edge]) {
+				continue;
+			}
+
+			auto to = task[edges[edge].to];
+			shared |= target != none && to != target;
+			target = to;
+		}
+
+		task[i] = target == none || shared ? tasks++ : target;
+	}
+
+	// Tasks only feed tasks created before them, so a task can run once all tasks created after it that feed it have run
+	std::vector<std::pair<size_t, size_t>> feeds;
+
+	for (size_t i = 0; i < edges.size(); i++) {
+		auto from = task[edges[i].from];
+		auto to = task[edges[i].to];
+
+		if (!feedback[i] && from != none && to != none && from != to) {
+			feeds.emplace_back(from, to);
+		}
+	}
+
+	std::sort(feeds.begin(), feeds.end(), std::greater<>());
+	std::vector<size_t> stage(tasks);
+
+	for (auto [from, to] : feeds) {
+		stage[to] = std::max(stage[to], stage[from] + 1);
+	}
+
+	// Modules reading values of the previous block directly from each other must not run at the same time
+	std::vector<size_t> merged(tasks);
+
+	for (size_t i = 0; i < tasks; i++) {
+		merged[i] = i;
+	}
+
+	auto find = [&merged](size_t i) {
+		while (merged[i] != i) {
+			i = merged[i] = merged[merged[i]];
+		}
+
+		return i;
+	};
+
+	for (size_t i = 0; i < edges.size(); i++) {
+		auto from = task[edges[i].from];
+		auto to = task[edges[i].to];
+
+		if (feedback[i] && (!edges[i].input || edges[i].nested) && from != none && to != none && stage[from] == stage[to]) {
+			merged[find(from)] = find(to);
+		}
+	}
+
+	// Collect the modules of every task in the order they must run, and sort the tasks by stage
+	std::vector<std::vector<Module *>> groups;
+	std::vector<size_t> group_stage;
+	std::unordered_map<size_t, size_t> group_index;
+
+	for (auto mod : schedule->modules) {
+		auto root = find(task[index[mod]]);
+		auto result = group_index.emplace(root, groups.size());
+
+		if (result.second) {
+			groups.emplace_back();
+			group_stage.push_back(stage[root]);
+		}
+
+		groups[result.first->second].push_back(mod);
+	}
+
+	std::vector<size_t> order(groups.size());
+
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&group_stage](size_t a, size_t b) {
+		return group_stage[a] < group_stage[b];
+	});
+
+	for (size_t k = 0; k < order.size(); k++) {
+		auto &mods = groups[order[k]];
+
+		if (!k || group_stage[order[k]] != group_stage[order[k - 1]]) {
+			schedule->stages.push_back({schedule->tasks.size(), schedule->tasks.size()});
+		}
+
+		schedule->tasks.push_back({schedule->parallel.size(), schedule->parallel.size() + mods.size()});
+		schedule->parallel.insert(schedule->parallel.end(), mods.begin(), mods.end());
+		schedule->stages.back().end = schedule->tasks.size();
+	}
+
+	return schedule;
+}
+
+/**
+ * Run all the modules for one block.
+ *
+ * This is called by the audio thread, after adopt().
+ *
+ * @param frames  The number of time steps to process.
+ */
+void Registry::run(size_t frames)
+{
+	auto schedule = current;
+
+	if (!schedule) {
+		return;
+	}
+
+	if (executor.threads() && schedule->block_processing) {
+		for (auto &stage : schedule->stages) {
+			executor.run(schedule->parallel.data(), schedule->tasks.data() + stage.begin, stage.end - stage.begin, frames);
+		}
+	} else if (Profiler::enabled.load(std::memory_order_relaxed)) {
+		// Measure every module separately
+		for (auto mod : schedule->modules) {
+			if (!mod->asleep()) {
+				Profiler::process(mod, frames);
+			}
+		}
+	} else {
+		auto mods = schedule->modules.data();
+
+		for (auto &batch : schedule->batches) {
+			mods[batch.begin]->process_batch(mods + batch.begin, batch.end - batch.begin, frames);
+		}
+	}
+
+	for (auto &fb : schedule->feedback) {
+		std::copy_n(fb.source, frames, fb.buffer);
+	}
+}
+
+}
@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "executor.hpp"
+#include "modsynth.hpp"
+
+namespace ModSynth
+{
+
+struct TapBuffer;
+
+/**
+ * The module registry.
+ *
+ * This is a singleton class that provides access to the vector of modules. We
+ * use this instead of a regular static variable since we can't guarantee that
+ * the vector modules will be initialized before any objects that are derived
+ * from Module.
+ *
+ * The registry also keeps track of all the connections between modules, and
+ * compiles them into a schedule that determines in which order the modules
+ * are run.
+ *
+ * The lists of modules and connections are only used by control threads,
+ * while holding #mutex. A compiled Schedule is handed over to the audio thread
+ * via the atomic #pending pointer, which the audio thread checks at the start
+ * of every block. Schedules the audio thread no longer uses are put on the
+ * #retired list, and are freed again by a control thread.
+ */
+struct Registry {
+	/**
+	 * A connection that is part of a feedback loop.
+	 *
+	 * The input of a feedback connection reads from a copy of the values its
+	 * output had in the previous block. This delays the loop by the length of
+	 * a block, normally Module::max_block_size time steps, or exactly one time
+	 * step if the schedule is not run in blocks.
+	 */
+	struct Feedback {
+		const float *source;                    ///< The buffer of the output of the connection.
+		float buffer[Module::max_block_size]{}; ///< The values of the output during the previous block.
+	};
+
+	/**
+	 * A compiled schedule.
+	 */
+	struct Schedule {
+		std::uint64_t generation{};     ///< The number of schedules published before this one.
+		std::vector<Module *> modules;  ///< The registered modules in the order they must be run.
+		std::vector<Executor::Task> batches; ///< The ranges of consecutive modules of the same type in #modules.
+		std::vector<Feedback> feedback; ///< The feedback connections.
+		bool block_processing{true};    ///< Whether all modules can be run one block at a time.
+		std::vector<std::pair<Input *, const float *>> buffers; ///< The buffers inputs must read from.
+		std::vector<std::pair<const Output *, bool>> outputs;  ///< Whether outputs are read by other modules.
+		std::vector<std::pair<Module *, const Module *>> controllers; ///< The modules that modules sleep with.
+		std::vector<std::pair<Module *, std::vector<Module *>>> children; ///< The modules nested in every container, in the order they must be run.
+
+		/// @name Parallel execution
+		///@{
+		std::vector<Module *> parallel;    ///< The modules that can run in parallel, grouped per task.
+		std::vector<Executor::Task> tasks; ///< The groups of modules in #parallel that have to run in order.
+		std::vector<Executor::Task> stages; ///< The ranges of #tasks that can run at the same time, in the order they must be run.
+		///@}
+
+		TapBuffer *tap{}; ///< The tap the final mix is copied to.
+
+		Schedule *next{}; ///< The next schedule in the list of retired schedules.
+	};
+
+	/**
+	 * A module that is run by another module instead of by the schedule.
+	 */
+	struct Nesting {
+		Module *child;     ///< The nested module.
+		Module *container; ///< The module running it.
+		float scale;       ///< The factor Module::dt is multiplied with while it runs.
+	};
+
+	/**
+	 * An object that has been removed, but might still be in use by the audio thread.
+	 */
+	struct Garbage {
+		void *object;               ///< The object to destroy.
+		void (*destroy)(void *);    ///< The function that destroys the object.
+		std::uint64_t generation;   ///< The schedule that no longer uses the object.
+	};
+
+	/// @name Control thread state
+	///@{
+	std::mutex mutex;                 ///< Protects the state used by control threads.
+	std::vector<Module *> modules;    ///< The list of committed modules, in order of registration.
+	std::vector<Module *> added;      ///< The list of modules added since the last commit.
+	std::vector<Input *> connections; ///< The list of inputs that are connected to an output.
+	std::vector<std::pair<Input *, std::uint64_t>> disconnected; ///< Inputs disconnected, and the schedule telling the audio thread.
+	std::vector<std::pair<const Output *, std::uint64_t>> released; ///< Outputs no longer read by an input, and the schedule telling the audio thread.
+	std::vector<std::pair<Module *, Input *>> writers; ///< Modules that write to inputs of other modules.
+	std::vector<std::pair<Module *, const Output *>> readers; ///< Modules that read from outputs of other modules.
+	std::vector<std::pair<Module *, const Module *>> sleepers; ///< Modules that sleep while another module is idle.
+	std::vector<Nesting> nested;      ///< Modules nested in other modules.
+	std::vector<Garbage> garbage;     ///< Objects waiting to be destroyed.
+	std::uint64_t generation{};       ///< The number of schedules published so far.
+	Executor executor;                ///< The worker threads running independent modules in parallel.
+	TapBuffer *tap{};                 ///< The tap the final mix is copied to.
+	///@}
+
+	/// @name State shared with the audio thread
+	///@{
+	std::atomic<Schedule *> pending{};    ///< A newly published schedule.
+	std::atomic<Schedule *> retired{};    ///< Schedules no longer used by the audio thread.
+	std::atomic<std::uint64_t> adopted{}; ///< The generation of the schedule used by the audio thread.
+	std::atomic<bool> running{};          ///< Whether the audio thread might be running.
+	///@}
+
+	Schedule *current{}; ///< The schedule used by the audio thread.
+
+	/**
+	 * The module currently being constructed.
+	 *
+	 * Inputs and outputs use this to find the module they belong to.
+	 */
+	static thread_local Module *constructing;
+
+	Registry() = default;
+	Registry(const Registry &other) = delete;
+	~Registry();
+
+	void add(Module *mod);
+	void remove(Module *mod);
+	void remove(Input *input);
+	void remove(const Output *output);
+	void remove(void *object, std::size_t size, void (*destroy)(void *));
+	void remove(TapBuffer *tap);
+	void connect(Input *input, const Output *output);
+	void disconnect(Input *input);
+	void write(Module *mod, Input *input);
+	void read(Module *mod, const Output *output);
+	void sleep(Module *mod, const Module *controller);
+	void nest(Module *child, Module *container, float scale);
+	void check_order(const std::vector<const Module *> &order);
+	void set_tap(TapBuffer *tap);
+
+	void commit();
+	void commit(const std::vector<std::pair<void *, std::size_t>> &removed);
+	void publish();
+	void synchronize(std::uint64_t generation);
+	void reclaim();
+	void set_running(bool running);
+	void prepare();
+
+	bool adopt();
+	void run(std::size_t frames);
+
+	/**
+	 * Get a reference to the global module registry instance.
+	 *
+	 * @return A reference to the module registry.
+	 */
+	static Registry &get();
+
+private:
+	Schedule *compile();
+	void forget(void *begin, void *end);
+	void detach(Input *input);
+	float scale(const Module *mod) const;
+};
+
+}
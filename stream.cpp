@@ -0,0 +1,250 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ModSynth
+{
+
+namespace
+{
+
+/**
+ * Resolve an address to connect to or listen on.
+ *
+ * @param host  The name or address of the host, or nullptr to listen on all addresses.
+ * @param port  The port number or service name.
+ * @return      The list of addresses, to be freed with freeaddrinfo().
+ */
+addrinfo *resolve(const char *host, const std::string &port)
+{
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = host ? 0 : AI_PASSIVE;
+
+	addrinfo *result;
+	int err = getaddrinfo(host, port.c_str(), &hints, &result);
+
+	if (err) {
+		throw std::runtime_error(std::string("could not resolve address: ") + gai_strerror(err));
+	}
+
+	return result;
+}
+
+/// Send every block right away instead of waiting to fill a packet.
+void set_nodelay(int fd)
+{
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+}
+
+}
+
+Stream::Stream(int fd): fd(fd)
+{
+	struct stat st;
+	socket = fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+
+	// Writes to a pipe whose reader is gone would kill the process instead of failing
+	if (!socket) {
+		std::signal(SIGPIPE, SIG_IGN);
+	}
+}
+
+Stream::~Stream()
+{
+	close(fd);
+}
+
+bool Stream::write(const float *samples, std::size_t count)
+{
+	auto ptr = reinterpret_cast<const char *>(samples);
+	auto size = count * sizeof *samples;
+
+	while (size) {
+		auto written = socket ? ::send(fd, ptr, size, MSG_NOSIGNAL) : ::write(fd, ptr, size);
+
+		if (written < 0 && errno == EINTR) {
+			continue;
+		} else if (written <= 0) {
+			return false;
+		}
+
+		ptr += written;
+		size -= written;
+	}
+
+	return true;
+}
+
+std::size_t Stream::read(float *samples, std::size_t count)
+{
+	auto ptr = reinterpret_cast<char *>(samples);
+	auto size = count * sizeof *samples;
+	std::size_t done = 0;
+
+	while (done < size) {
+		auto got = ::read(fd, ptr + done, size - done);
+
+		if (got < 0 && errno == EINTR) {
+			continue;
+		} else if (got <= 0) {
+			break;
+		}
+
+		done += got;
+	}
+
+	return done / sizeof *samples;
+}
+
+int connect_tcp(const std::string &host, const std::string &port)
+{
+	auto addresses = resolve(host.c_str(), port);
+
+	for (auto address = addresses; address; address = address->ai_next) {
+		int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+		if (fd == -1) {
+			continue;
+		}
+
+		if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+			freeaddrinfo(addresses);
+			set_nodelay(fd);
+			return fd;
+		}
+
+		close(fd);
+	}
+
+	freeaddrinfo(addresses);
+	throw std::runtime_error("could not connect to " + host + " port " + port);
+}
+
+int accept_tcp(const std::string &port)
+{
+	auto addresses = resolve(nullptr, port);
+	int server = -1;
+
+	for (auto address = addresses; address && server == -1; address = address->ai_next) {
+		server = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+		if (server == -1) {
+			continue;
+		}
+
+		int one = 1;
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+		if (bind(server, address->ai_addr, address->ai_addrlen) != 0 || listen(server, 1) != 0) {
+			close(server);
+			server = -1;
+		}
+	}
+
+	freeaddrinfo(addresses);
+
+	if (server == -1) {
+		throw std::runtime_error("could not listen on port " + port + ": " + std::strerror(errno));
+	}
+
+	int fd;
+
+	do {
+		fd = accept(server, nullptr, nullptr);
+	} while (fd == -1 && errno == EINTR);
+
+	auto err = errno;
+	close(server);
+
+	if (fd == -1) {
+		throw std::runtime_error(std::string("could not accept a connection: ") + std::strerror(err));
+	}
+
+	set_nodelay(fd);
+	return fd;
+}
+
+Sender::Sender(Stream &stream, size_t channels): in(channels), stream(stream), buffer(channels * max_block_size)
+{
+}
+
+void Sender::process(size_t frames)
+{
+	auto channels = in.size();
+
+	for (size_t c = 0; c < channels; c++) {
+		for (size_t i = 0; i < frames; i++) {
+			buffer[i * channels + c] = in[c][i];
+		}
+	}
+
+	if (failed) {
+		return;
+	}
+
+	// There is nobody to report an error to, the receiving side will see the stream end
+	failed = !stream.write(buffer.data(), frames * channels);
+}
+
+Receiver::Receiver(Stream &stream, size_t channels, size_t latency):
+	out(channels),
+	latency(latency),
+	stream(stream),
+	buffer(channels * max_block_size),
+	remaining(latency)
+{
+	if (!channels) {
+		throw std::invalid_argument("a receiver needs at least one channel");
+	}
+}
+
+void Receiver::process(size_t frames)
+{
+	auto channels = out.size();
+	size_t start = std::min(frames, remaining);
+	remaining -= start;
+
+	for (auto &output : out) {
+		std::fill_n(&output[0], start, 0.0f);
+	}
+
+	if (start == frames) {
+		return;
+	}
+
+	auto count = frames - start;
+	size_t received = 0;
+
+	if (!ended) {
+		received = stream.read(buffer.data(), count * channels) / channels;
+		ended = received < count;
+	}
+
+	for (size_t c = 0; c < channels; c++) {
+		for (size_t i = 0; i < received; i++) {
+			out[c][start + i] = buffer[i * channels + c];
+		}
+
+		if (received < count) {
+			std::fill_n(&out[c][start + received], count - received, 0.0f);
+		}
+	}
+}
+
+}
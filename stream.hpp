@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "modsynth.hpp"
+
+/**
+ * @file stream.hpp
+ * @brief Streaming signals between processes, to split a patch over several processes or hosts.
+ */
+
+namespace ModSynth
+{
+
+/**
+ * @brief A stream of samples to or from another process.
+ *
+ * Samples are sent as interleaved 32-bit floating point values in the native
+ * byte order, without any header, over a file descriptor. This can be a pipe
+ * or a UNIX domain socket to another process on the same host, or a TCP
+ * connection to another host. Reads and writes block until all samples are
+ * transferred.
+ */
+struct Stream {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param fd  The file descriptor to read from or write to, which the stream takes ownership of.
+	 *
+	 * If @p fd is not a socket, SIGPIPE is ignored for the whole process, so
+	 * that writing to a pipe that was closed on the other end fails instead
+	 * of killing the process.
+	 */
+	explicit Stream(int fd);
+	Stream(const Stream &other) = delete;
+	~Stream();
+
+	/**
+	 * @brief Write samples to the stream.
+	 *
+	 * @param samples  The samples to write.
+	 * @param count    The number of samples.
+	 * @return         Whether all samples were written, which is false once the other end has closed the stream.
+	 */
+	bool write(const float *samples, std::size_t count);
+
+	/**
+	 * @brief Read samples from the stream.
+	 *
+	 * @param samples  Where to store the samples.
+	 * @param count    The number of samples.
+	 * @return         The number of samples read, which is less than @p count only at the end of the stream.
+	 */
+	std::size_t read(float *samples, std::size_t count);
+
+private:
+	int fd;      ///< The file descriptor.
+	bool socket; ///< Whether the file descriptor is a socket.
+};
+
+/**
+ * @brief Connect to another host over TCP.
+ *
+ * @param host  The name or address of the host.
+ * @param port  The port number or service name.
+ * @return      The file descriptor of the connection.
+ */
+int connect_tcp(const std::string &host, const std::string &port);
+
+/**
+ * @brief Wait for a connection from another host over TCP.
+ *
+ * @param port  The port number or service name to listen on.
+ * @return      The file descriptor of the first connection made to that port.
+ */
+int accept_tcp(const std::string &port);
+
+/**
+ * @brief A module that sends its inputs to a Stream.
+ *
+ * This takes the place of a Speaker at the end of a segment of a patch that
+ * runs in another process. Every block is written as soon as it is
+ * generated, so the process reading the stream can work on it in parallel.
+ * Writes wait while the stream is full, so this is meant for offline
+ * rendering with render(), not for the live audio output.
+ */
+struct Sender: Module {
+	/// @name Inputs
+	///@{
+	std::vector<Input> in; ///< The signal of each channel.
+	///@}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param stream    The stream to write to.
+	 * @param channels  The number of inputs.
+	 */
+	Sender(Stream &stream, std::size_t channels);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	Stream &stream;            ///< The stream to write to.
+	std::vector<float> buffer; ///< The interleaved samples of one block.
+	bool failed{};             ///< Whether a write failed, after which nothing more is written.
+};
+
+/**
+ * @brief A module that outputs the signals read from a Stream.
+ *
+ * The samples are read in the same number of frames as this process
+ * generates, regardless of the block sizes of the process writing them, so
+ * the signals stay aligned to the exact time step. Reads wait until enough
+ * samples have arrived.
+ *
+ * If two processes send signals to each other, they would each wait for the
+ * other forever. A #latency of at least Module::max_block_size time steps on
+ * one of the two Receivers breaks the cycle: it outputs that many time steps
+ * of silence before the first sample it reads. Signals that did not go
+ * through the Receiver can be delayed by the same number of time steps to
+ * stay aligned with it, for example with a Delay that uses
+ * Interpolation::NONE.
+ *
+ * At the end of the stream, the outputs become silent.
+ */
+struct Receiver: Module {
+	/// @name Outputs
+	///@{
+	std::vector<Output> out; ///< The signal of each channel.
+	///@}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param stream    The stream to read from.
+	 * @param channels  The number of outputs.
+	 * @param latency   The number of time steps of silence to output before the signals read.
+	 */
+	Receiver(Stream &stream, std::size_t channels, std::size_t latency = 0);
+
+	/// Check whether the end of the stream was reached, after rendering.
+	bool finished() const
+	{
+		return ended;
+	}
+
+	const std::size_t latency; ///< The delay added to the signals in time steps.
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	bool block_processing() const override { return true; }
+
+private:
+	Stream &stream;            ///< The stream to read from.
+	std::vector<float> buffer; ///< The interleaved samples of one block.
+	std::size_t remaining;     ///< The number of time steps of the #latency still to output.
+	bool ended{};              ///< Whether the end of the stream has been reached.
+};
+
+}
@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: MIT */
+
+#include "tap.hpp"
+#include "registry.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ModSynth
+{
+
+namespace
+{
+
+const char tap_magic[8] = "MSTAP1";
+
+/// Throw an exception for a failed system call on a shared memory object.
+[[noreturn]] void fail(const char *what, const std::string &name)
+{
+	throw std::runtime_error(std::string("could not ") + what + " " + name + ": " + std::strerror(errno));
+}
+
+/**
+ * Round the capacity of a tap up to a power of two.
+ *
+ * @param capacity  The number of frames requested.
+ * @return          The number of frames that will be kept.
+ */
+std::size_t round_capacity(std::size_t capacity)
+{
+	if (!capacity || capacity > (std::size_t(1) << 31)) {
+		throw std::invalid_argument("tap capacity out of range");
+	}
+
+	return std::bit_ceil(capacity);
+}
+
+}
+
+TapBuffer::TapBuffer(const std::string &name, size_t channels, size_t capacity):
+	channels(channels),
+	name(name),
+	mask(round_capacity(capacity) - 1),
+	size(sizeof(TapHeader) + channels * (mask + 1) * sizeof(float))
+{
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+
+	if (fd == -1) {
+		fail("create", name);
+	}
+
+	if (ftruncate(fd, size) != 0) {
+		auto err = errno;
+		close(fd);
+		shm_unlink(name.c_str());
+		errno = err;
+		fail("resize", name);
+	}
+
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	auto err = errno;
+	close(fd);
+
+	if (memory == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		errno = err;
+		fail("map", name);
+	}
+
+	// Touch every page now, so the audio thread never has to wait for one
+	std::memset(memory, 0, size);
+
+	header = static_cast<TapHeader *>(memory);
+	samples = reinterpret_cast<float *>(header + 1);
+	std::copy_n(tap_magic, sizeof tap_magic, header->magic);
+	header->channels = channels;
+	header->capacity = mask + 1;
+}
+
+TapBuffer::~TapBuffer()
+{
+	Registry::get().remove(this);
+	munmap(header, size);
+	shm_unlink(name.c_str());
+}
+
+void tap_mix(TapBuffer *tap)
+{
+	Registry::get().set_tap(tap);
+}
+
+Tap::Tap(const std::string &name, size_t channels, size_t capacity): in(channels), buffer(name, channels, capacity)
+{
+	buffer.prepare();
+}
+
+void Tap::prepare()
+{
+	buffer.prepare();
+}
+
+void Tap::process(size_t frames)
+{
+	buffer.write(frames, [&](size_t c, size_t i) {
+		return in[c][i];
+	});
+}
+
+TapReader::TapReader(const std::string &name)
+{
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if (fd == -1) {
+		fail("open", name);
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0) {
+		auto err = errno;
+		close(fd);
+		errno = err;
+		fail("stat", name);
+	}
+
+	size = st.st_size;
+	void *memory = size >= sizeof(TapHeader) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	auto err = errno;
+	close(fd);
+
+	if (memory == MAP_FAILED) {
+		errno = err;
+		fail("map", name);
+	}
+
+	header = static_cast<const TapHeader *>(memory);
+	samples = reinterpret_cast<const float *>(header + 1);
+
+	if (!std::equal(tap_magic, tap_magic + sizeof tap_magic, header->magic) ||
+	    size < sizeof(TapHeader) + std::size_t(header->channels) * header->capacity * sizeof(float)) {
+		munmap(memory, size);
+		throw std::runtime_error(name + " is not a tap");
+	}
+}
+
+TapReader::~TapReader()
+{
+	munmap(const_cast<TapHeader *>(header), size);
+}
+
+bool TapReader::read(size_t channel, std::uint64_t from, float *out, size_t frames) const
+{
+	if (channel >= channels()) {
+		throw std::invalid_argument("tap channel out of range");
+	}
+
+	auto capacity = this->capacity();
+	auto end = position();
+
+	if (from + frames > end || end - from > capacity) {
+		return false;
+	}
+
+	// Copy up to the end of the ring buffer, then from its start
+	auto ring = this->channel(channel);
+	size_t index = from & (capacity - 1);
+	size_t first = std::min(frames, capacity - index);
+	std::copy_n(ring + index, first, out);
+	std::copy_n(ring, frames - first, out + first);
+
+	// If the writer started overwriting any of these frames, the copy cannot be trusted
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return header->writing.load(std::memory_order_relaxed) - from <= capacity;
+}
+
+}
@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "modsynth.hpp"
+
+/**
+ * @file tap.hpp
+ * @brief Shared memory taps that let other processes read signals while they are generated.
+ */
+
+namespace ModSynth
+{
+
+/**
+ * @brief The layout of the start of a tap's shared memory.
+ *
+ * The header is followed by one ring buffer of #capacity samples per
+ * channel, channel after channel.
+ */
+struct alignas(64) TapHeader {
+	char magic[8];                       ///< "MSTAP1", followed by zeros.
+	std::uint32_t channels;              ///< The number of channels.
+	std::uint32_t capacity;              ///< The number of frames in the ring buffers, a power of two.
+	std::atomic<float> sample_rate;      ///< The sample rate the frames are written at, or zero if not known yet.
+	std::atomic<std::uint64_t> writing;  ///< The number of frames written once the current write is done.
+	std::atomic<std::uint64_t> written;  ///< The number of frames written so far.
+
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<float>::is_always_lock_free, "shared memory needs lock-free atomics");
+};
+
+/**
+ * @brief A ring buffer in shared memory that the audio thread writes signals to.
+ *
+ * Other processes open the same name with a TapReader to read the signals.
+ * Writing never blocks and never waits for readers; a reader that falls
+ * behind by more than the capacity notices the samples it missed were
+ * overwritten. The memory is touched in the constructor, so the audio thread
+ * does not cause page faults when it first writes to it.
+ */
+struct TapBuffer {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param name      The name of the shared memory object, starting with a slash.
+	 * @param channels  The number of channels.
+	 * @param capacity  The number of frames kept, rounded up to a power of two.
+	 */
+	TapBuffer(const std::string &name, std::size_t channels, std::size_t capacity = 1 << 16);
+	TapBuffer(const TapBuffer &other) = delete;
+
+	/**
+	 * @brief The destructor.
+	 *
+	 * If this tap receives the final mix, it is removed first. The shared
+	 * memory is unlinked, but readers that have it open keep access to it.
+	 */
+	~TapBuffer();
+
+	/**
+	 * @brief Tell readers the sample rate frames are written at.
+	 *
+	 * This stores the inverse of Module::dt of the calling thread. The
+	 * registry calls this when the tap starts receiving the final mix, and
+	 * Tap calls this whenever it is prepared. Until then, readers see a
+	 * sample rate of zero.
+	 */
+	void prepare()
+	{
+		header->sample_rate.store(1.0f / Module::dt, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Append frames to the ring buffers.
+	 *
+	 * This is only called by the audio thread.
+	 *
+	 * @param frames  The number of frames to write.
+	 * @param sample  A function returning the sample of a given channel and frame.
+	 */
+	template<typename Sample>
+	void write(std::size_t frames, Sample sample)
+	{
+		auto position = header->written.load(std::memory_order_relaxed);
+
+		// Let readers know which frames are about to be overwritten
+		header->writing.store(position + frames, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (std::size_t c = 0; c < channels; c++) {
+			float *ring = samples + c * (mask + 1);
+
+			for (std::size_t i = 0; i < frames; i++) {
+				ring[(position + i) & mask] = sample(c, i);
+			}
+		}
+
+		header->written.store(position + frames, std::memory_order_release);
+	}
+
+	const std::size_t channels; ///< The number of channels.
+
+private:
+	std::string name;    ///< The name of the shared memory object.
+	std::size_t mask;    ///< The capacity minus one.
+	std::size_t size;    ///< The size of the shared memory.
+	TapHeader *header;   ///< The start of the shared memory.
+	float *samples;      ///< The ring buffers.
+};
+
+/**
+ * @brief Send a copy of the final mix to a tap.
+ *
+ * Every frame sent to the audio output, after the gain and the limiter, is
+ * also written to the @p tap. Channels the tap has but the output does not
+ * are silent. When this returns, the audio thread no longer writes to the
+ * previous tap.
+ *
+ * @param tap  The tap to write the mix to, or nullptr to stop.
+ */
+void tap_mix(TapBuffer *tap);
+
+/**
+ * @brief A module that writes its inputs to a TapBuffer.
+ *
+ * Connect the inputs to any outputs to let other processes meter, record or
+ * analyze them.
+ */
+struct Tap: Module {
+	/// @name Inputs
+	///@{
+	std::vector<Input> in; ///< The signal of each channel.
+	///@}
+
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param name      The name of the shared memory object, starting with a slash.
+	 * @param channels  The number of inputs.
+	 * @param capacity  The number of frames kept, rounded up to a power of two.
+	 */
+	Tap(const std::string &name, std::size_t channels, std::size_t capacity = 1 << 16);
+
+	void process(std::size_t frames) override; ///< The function that will update the state of this module.
+	void prepare() override;
+	bool block_processing() const override { return true; }
+
+private:
+	TapBuffer buffer; ///< The shared memory written to.
+};
+
+/**
+ * @brief Read access to a TapBuffer of another process.
+ *
+ * The ring buffers are mapped read-only, so they can be read directly
+ * without copying. Since the writer never waits, samples can be overwritten
+ * while they are being looked at. read() copies samples and checks that they
+ * were not overwritten in the mean time.
+ */
+struct TapReader {
+	/**
+	 * @brief The constructor.
+	 *
+	 * @param name  The name of the shared memory object.
+	 */
+	explicit TapReader(const std::string &name);
+	TapReader(const TapReader &other) = delete;
+	~TapReader();
+
+	std::size_t channels() const { return header->channels; } ///< Get the number of channels.
+	std::size_t capacity() const { return header->capacity; } ///< Get the number of frames kept.
+	float sample_rate() const { return header->sample_rate.load(std::memory_order_relaxed); } ///< Get the sample rate, or zero if the writer did not set it yet.
+
+	/// Get the number of frames written so far.
+	std::uint64_t position() const
+	{
+		return header->written.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * @brief Get the ring buffer of a channel.
+	 *
+	 * Frame @c n is stored at index @c n modulo capacity(), once position()
+	 * is larger than @c n. It is overwritten when the writer gets to frame
+	 * @c n plus capacity(), which can happen while it is being looked at.
+	 *
+	 * @param channel  The channel.
+	 * @return         A pointer to the start of the ring buffer.
+	 */
+	const float *channel(std::size_t channel) const
+	{
+		return samples + channel * header->capacity;
+	}
+
+	/**
+	 * @brief Copy frames of a channel.
+	 *
+	 * @param channel  The channel.
+	 * @param from     The number of the first frame to copy.
+	 * @param out      Where to store the samples.
+	 * @param frames   The number of frames to copy.
+	 * @return         Whether the frames were written and not overwritten yet.
+	 */
+	bool read(std::size_t channel, std::uint64_t from, float *out, std::size_t frames) const;
+
+private:
+	std::size_t size;        ///< The size of the shared memory.
+	const TapHeader *header; ///< The start of the shared memory.
+	const float *samples;    ///< The ring buffers.
+};
+
+}